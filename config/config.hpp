@@ -11,9 +11,39 @@ struct Config {
     std::string zones_csv_file;
     std::string spatial_eta_path;
     int time_zoning_type;
-    std::string routingengine_server;
-    std::string engine;
+    std::string time_seasons;         // optional: season of every month from January (default "4,4,1,1,1,2,2,2,3,3,3,4")
+    std::string time_hour_ranges;     // optional: hour ranges of the range zonings (default "0-6,7-10,11-13,14-16,17-19,20-23")
+    std::string time_zone;            // optional: local time zone of the epoch start times, "UTC" (default) or a tz database name
+    std::string routingengine_server; // host, or comma separated host[:port] list of the engine replicas
+    std::string engine;               // osrm, ors, val, or mock / mock:<recorded queries csv> for the in-process stand-in
     std::string aggregate_type;
+    std::string aggregate_storage;    // optional: "full" (default) or "compact" (only aggregate_type)
+    std::string aggregate_precision;  // optional: "f64" (default), "f32" or "u16"
+    size_t spatial_cache_tables;      // optional: max mapped SpatialETA tables (default 1024)
+    size_t spatial_cache_mb;          // optional: max mapped SpatialETA megabytes (default 4096)
+    int spatial_search_levels;        // optional: max levels of the in-memory search tree per table, 0 disables (default 16)
+    long long spatial_search_min_records; // optional: min records of a table to get a search tree (default 4096)
+    std::string spatial_index;        // optional: "grid" (default) or "quadtree" index of the zones
+    size_t spatial_index_leaf_size;   // optional: max zones per quadtree leaf (default 8)
+    int spatial_grid_cells_per_degree; // optional: grid resolution, 0 sizes the cells from the zones (default 0)
+    std::string spatial_pip_kernel;   // optional: point in polygon kernel "auto" (default), "scalar", "avx2" or "avx512"
+    size_t engine_pool_size;          // optional: keep-alive connections to the routing engine server (default 4)
+    size_t engine_matrix_max_locations; // optional: max sources + targets per engine matrix call of a batch (default 100)
+    size_t engine_cache_entries;      // optional: cached routing engine ETAs, 0 disables the cache (default 0)
+    int engine_cache_precision;       // optional: decimal places of the snapped cache coordinates (default 5, ~1.1 m)
+    double engine_cache_ttl_s;        // optional: lifetime of a cached engine ETA in seconds (default 3600)
+    bool engine_coalesce;             // optional: identical concurrent engine calls share one call (default 1)
+    int engine_connect_timeout_ms;    // optional: max time of a connect to the routing engine, 0 for none (default 2000)
+    int engine_read_timeout_ms;       // optional: max silence of the routing engine while answering, 0 for none (default 30000)
+    double engine_deadline_ms;        // optional: budget of a query for its engine call, 0 for none (default 0)
+    std::string deadline_fallback;    // optional: "error" (default, -1) or "coarse" (median aggregate) past the budget
+    double engine_hedge_percentile;   // optional: hedge a call to the next replica after this latency percentile, 0 disables (default 0)
+    size_t engine_async_connections;  // optional: non-blocking connections of the async engine calls (default 8)
+    size_t engine_pipeline_depth;     // optional: requests pipelined per async connection, 1 disables pipelining (default 16)
+    size_t pipeline_pre_threads;      // optional: threads of the pre-engine stage of the async requests (default 2)
+    size_t pipeline_post_threads;     // optional: threads of the post-engine stage of the async requests (default 2)
+    size_t pipeline_prefetch_kb;      // optional: largest SpatialETA table prefetched during the engine call (default 1024)
+    size_t worker_threads;            // optional: threads of the parallel batch requests, 0 for all hardware threads (default 0)
 
     static Config load(const std::string& path) {
         // Parse key=value file
@@ -38,9 +68,39 @@ struct Config {
         c.zones_csv_file       = get(kv, "zones_csv_file");
         c.spatial_eta_path     = get(kv, "spatial_eta_path");
         c.time_zoning_type     = std::stoi(get(kv, "time_zoning_type"));
+        c.time_seasons         = getOr(kv, "time_seasons", "4,4,1,1,1,2,2,2,3,3,3,4");
+        c.time_hour_ranges     = getOr(kv, "time_hour_ranges", "0-6,7-10,11-13,14-16,17-19,20-23");
+        c.time_zone            = getOr(kv, "time_zone", "UTC");
         c.routingengine_server = get(kv, "routingengine_server");
         c.engine               = get(kv, "engine");
         c.aggregate_type       = get(kv, "aggregate_type");
+        c.aggregate_storage    = getOr(kv, "aggregate_storage", "full");
+        c.aggregate_precision  = getOr(kv, "aggregate_precision", "f64");
+        c.spatial_cache_tables = std::stoul(getOr(kv, "spatial_cache_tables", "1024"));
+        c.spatial_cache_mb     = std::stoul(getOr(kv, "spatial_cache_mb", "4096"));
+        c.spatial_search_levels      = std::stoi(getOr(kv, "spatial_search_levels", "16"));
+        c.spatial_search_min_records = std::stoll(getOr(kv, "spatial_search_min_records", "4096"));
+        c.spatial_index              = getOr(kv, "spatial_index", "grid");
+        c.spatial_index_leaf_size    = std::stoul(getOr(kv, "spatial_index_leaf_size", "8"));
+        c.spatial_grid_cells_per_degree = std::stoi(getOr(kv, "spatial_grid_cells_per_degree", "0"));
+        c.spatial_pip_kernel         = getOr(kv, "spatial_pip_kernel", "auto");
+        c.engine_pool_size     = std::stoul(getOr(kv, "engine_pool_size", "4"));
+        c.engine_matrix_max_locations = std::stoul(getOr(kv, "engine_matrix_max_locations", "100"));
+        c.engine_cache_entries   = std::stoul(getOr(kv, "engine_cache_entries", "0"));
+        c.engine_cache_precision = std::stoi(getOr(kv, "engine_cache_precision", "5"));
+        c.engine_cache_ttl_s     = std::stod(getOr(kv, "engine_cache_ttl_s", "3600"));
+        c.engine_coalesce        = std::stoi(getOr(kv, "engine_coalesce", "1")) != 0;
+        c.engine_connect_timeout_ms = std::stoi(getOr(kv, "engine_connect_timeout_ms", "2000"));
+        c.engine_read_timeout_ms    = std::stoi(getOr(kv, "engine_read_timeout_ms", "30000"));
+        c.engine_deadline_ms        = std::stod(getOr(kv, "engine_deadline_ms", "0"));
+        c.deadline_fallback         = getOr(kv, "deadline_fallback", "error");
+        c.engine_hedge_percentile   = std::stod(getOr(kv, "engine_hedge_percentile", "0"));
+        c.engine_async_connections = std::stoul(getOr(kv, "engine_async_connections", "8"));
+        c.engine_pipeline_depth    = std::stoul(getOr(kv, "engine_pipeline_depth", "16"));
+        c.pipeline_pre_threads  = std::stoul(getOr(kv, "pipeline_pre_threads", "2"));
+        c.pipeline_post_threads = std::stoul(getOr(kv, "pipeline_post_threads", "2"));
+        c.pipeline_prefetch_kb  = std::stoul(getOr(kv, "pipeline_prefetch_kb", "1024"));
+        c.worker_threads       = std::stoul(getOr(kv, "worker_threads", "0"));
         return c;
     }
 
@@ -57,4 +117,10 @@ private:
         if (it == kv.end()) throw std::runtime_error("Missing config key: " + key);
         return it->second;
     }
+
+    static std::string getOr(const std::map<std::string, std::string>& kv,
+                             const std::string& key, const std::string& fallback) {
+        auto it = kv.find(key);
+        return (it == kv.end()) ? fallback : it->second;
+    }
 };
\ No newline at end of file
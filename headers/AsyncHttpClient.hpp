@@ -0,0 +1,111 @@
+#ifndef ASYNC_HTTP_CLIENT_H
+#define ASYNC_HTTP_CLIENT_H
+
+#include "../headers/HttpClient.hpp"
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+
+// Non-blocking HTTP/1.1 client to one server (host:port) driven by an epoll event loop thread
+// Requests are spread over up to max_connections non-blocking keep-alive connections and pipelined
+// up to pipeline_depth per connection (a new connection is opened before pipelining on a busy one),
+// so a few threads keep thousands of requests in flight. Completions are delivered by callback on the
+// event loop thread (keep them short, hand heavy work to another executor) or through a future
+// Requests sent on a connection that the server closes before answering them are resent (as long as
+// the connection had answered earlier ones), pipelining stops if the server does not keep connections alive
+// The event loop fails the requests past their deadline, the connect timeout or the read timeout with HttpTimeout
+// (a connection holding an expired request is closed, its other requests may have reached the server already:
+// the GETs are resent, the others fail with the timeout too so a POST body is never sent twice)
+class AsyncHttpClient {
+public:
+    // body of the response, or error set if the request failed (body empty then)
+    using Callback = std::function<void(std::string body, std::exception_ptr error)>;
+
+    AsyncHttpClient(const std::string& host, int port, size_t max_connections = 8, size_t pipeline_depth = 16);
+    ~AsyncHttpClient(); // the requests still pending fail with an error
+
+    AsyncHttpClient(const AsyncHttpClient&) = delete;
+    AsyncHttpClient& operator=(const AsyncHttpClient&) = delete;
+
+    // max time of a connect and max silence of the server while a request is waiting for its response,
+    // 0 for none (the default), set before the first request
+    void setTimeouts(int connect_timeout_ms, int read_timeout_ms);
+
+    // queue the request and return at once (thread-safe), throws if the host cannot be resolved
+    void request(const std::string& method, const std::string& path, const std::string& body, Callback done,
+                 HttpDeadline deadline = HttpDeadline::max());
+    std::future<std::string> request(const std::string& method, const std::string& path, const std::string& body = "");
+
+    size_t connectionsOpened() const { return opened.load(); } // connections opened so far
+    uint64_t pipelinedRequests() const { return pipelined.load(); } // requests sent behind an unanswered one
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        std::string bytes;   // request bytes
+        Callback done;
+        HttpDeadline deadline;
+        bool idempotent;     // a GET, safe to send again after the server may have processed it
+    };
+
+    struct Connection {
+        int sock = -1;
+        bool connecting = true;
+        bool answered = false;         // got at least one response (a kept-alive connection)
+        bool want_write = true;        // EPOLLOUT registered
+        std::string out;               // bytes not sent yet
+        size_t out_sent = 0;
+        std::deque<Pending> in_flight; // sent or queued on this connection, in response order
+        std::string in;                // bytes received, not parsed yet
+        HttpDeadline connect_by;       // connect timeout
+        HttpDeadline read_by;          // read timeout of the pending responses (from the last bytes sent or received)
+    };
+
+    std::string host;
+    int port;
+    size_t max_connections;
+    size_t pipeline_depth;
+    int connect_timeout_ms = 0;
+    int read_timeout_ms = 0;
+
+    std::once_flag started;  // resolve the host and start the event loop on the first request
+    std::thread loop;
+    int epoll_fd = -1;
+    int wake_fd = -1;        // eventfd signaling new requests or stopping
+    std::string request_host;
+    std::vector<char> addr;  // resolved sockaddr
+
+    std::mutex mutex;                // guards submitted and stopping
+    std::deque<Pending> submitted;   // handed over to the event loop
+    bool stopping = false;
+
+    // event loop thread only
+    std::deque<Pending> waiting;     // not assigned to a connection yet
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    bool persistent = true;          // the server keeps its connections alive (else no pipelining)
+
+    std::atomic<size_t> opened{0};
+    std::atomic<uint64_t> pipelined{0};
+
+    void start();
+    void run();
+    void dispatch();                       // assign the waiting requests to connections
+    Connection* openConnection();          // nullptr if the connect fails at once
+    void flush(Connection& c);             // write out as much as the socket takes
+    void receive(Connection& c);           // read and complete the parsed responses
+    void updateEvents(Connection& c);
+    void drop(Connection& c, std::exception_ptr error); // close, resend or fail its requests
+    void expire();                         // fail the requests out of time
+    int nextTimeout() const;               // epoll_wait timeout until the next expiry, -1 if none
+    HttpDeadline after(int timeout_ms) const; // now + timeout_ms, max() if 0
+};
+
+#endif // ASYNC_HTTP_CLIENT_H
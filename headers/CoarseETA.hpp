@@ -2,26 +2,26 @@
 #define COARSE_ETA_H
 
 #include "../headers/ReadZones.hpp"
+#include "../headers/ZoneSnapshot.hpp"
+#include "../headers/HashIndex.hpp"
+#include "../headers/TimeZoning.hpp"
+#include "../headers/SpatialETATables.hpp"
+#include "../headers/HttpClient.hpp"
+#include "../headers/AsyncHttpClient.hpp"
+#include "../headers/EngineReplicas.hpp"
+#include "../headers/RoutingBackend.hpp"
+#include "../headers/JsonExtract.hpp"
+#include "../headers/EngineCache.hpp"
+#include "../headers/SingleFlight.hpp"
+#include "../headers/WorkerPool.hpp"
+#include "../headers/Executor.hpp"
 #include <ctime>
 #include <iomanip>
 #include <stdexcept>
 #include <cstring>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <unistd.h>
 #include <cstdio>
 #include <chrono>
 
-// Type of time zoning to use
-enum TimeZoningType {
-    DOW_HOD = 0,
-    DAYTYPE_HOD = 1,
-    DOW_RANGE = 2,
-    DAYTYPE_RANGE = 3
-};
-
 // ETA Query <s, d, t>
 struct ETAQuery {
     double start_long;
@@ -29,24 +29,7 @@ struct ETAQuery {
     double end_long;
     double end_lat;
     std::string start_datetime;
-};
-
-struct TimeZone {
-    int season;           // 1 (Dec-Feb), 2 (Mar-May), 3 (Jun-Aug), 4 (Sep-Nov) for seasons
-    int day_of_week;      // 0-6 (Mon=0, Tues=1, Wed=2, Thu=3, Fri=4, Sat=5, Sunday=6) 
-    std::string daytype;  // "weekday" or "weekend"
-    int adjusted_hour;    // 0-23 with rounding to the nearest hour
-    int start_hour;       // start of hour range for time periods
-    int end_hour;         // end of hour range for time periods
-    
-    // For debugging
-    void print() const {
-        std::cout << "Season: " << season << ", " 
-                  << "Day of week: " << day_of_week << ", "
-                  << "Daytype: " << daytype << ", "
-                  << "Adjusted hour: " << adjusted_hour << ", "
-                  << "Hour range: [" << start_hour << " - " << end_hour << "]\n";
-    }
+    int64_t start_epoch = -1; // start time in Unix seconds, zoned in the local time zone instead of start_datetime if >= 0
 };
 
 // SpatialETA Table search result
@@ -57,6 +40,7 @@ struct SearchResult {
     long long record_eta2;   // min ETA > os_eta
     double    eta2;
     double  total_records; // total records in file
+    long long ties;          // on an exact match in a quantile sketch, knots after record_eta1 with the same ETA (ranked at the middle)
 };
 
 //Aggregate List search result
@@ -66,84 +50,147 @@ struct StatResult {
     int rank2;  double eta2;  // rank2 > rank_p, eta2
 };
 
+// Query after the stages before the routing engine: spatial zoning, temporal zoning and the hash index lookup
+struct ZonedQuery {
+    uint32_t start_zone;  // dense zone index of the starting point
+    uint32_t end_zone;    // dense zone index of the ending point
+    double aggregates[HashIndex::MAX_FIELD_VALUES]; // ground truth aggregate values of the selected aggregate type
+};
+
 struct Timing {
     double routing_engine; // time taken by the routing engine
     double total; // total time of the query response
     double coarseETA; // overhead by coarseETA operations (total time - routing engine time)
 };
 
+// ETA and timing of an async ETA request
+struct ETAResponse {
+    double eta;    // -1 on error
+    Timing timing;
+};
+
 //CoarseETA Online Phase for Answering ETA Queries
 class CoarseETA {
 private:
-    //The groundtruth values corresponding to the statistical percentiles
-    struct AggregateValues {
-        std::vector<double> min_max;       // [0,100]
-        std::vector<double> min_med_max;   // [0,50,100]
-        std::vector<double> percentiles;   // [0,25,50,75,100]
-    };
-    
     // type of percentiles used for the ground truth dataset (min_max:[0,100] or min_med_max[0,50,100] or percentiles[0,25,50,75,100])
-    using PercentileField = std::vector<double> AggregateValues::*;
-    PercentileField field;
+    AggregateField field = ALL_FIELDS;
     std::string aggregate_type; // aggregate type to be used (min_max:[0,100] or min_med_max[0,50,100] or percentiles[0,25,50,75,100])
     std::string hashTable_file; // Path to the hash table of the coarse zone-to-zone od matrix
-    std::map<std::string, AggregateValues> hash_table; // hash index of the coarse zone to zone od matrix
     TimeZoningType time_zoning_type; // type of time zoning to use
+    TimeZoning time_zoning; // time bits of the start times for the time zoning type
     std::map<std::string, std::vector<double>> aggregate_ranks; // the ranks of the aggregates 
+    const std::vector<double>* ranks = nullptr; // ranks of the selected aggregate type
 
-    std::string spatialETA_path; // SpatialETA tables folder path
+    std::string spatialETA_path; // SpatialETA tables folder path or archive file path
     int record_size; // single record size in the SpatialETA table
     int eta_offset; // offset of the eta bytes in a single record
 
-    std::string routingengine_server; // routing engine server ip
+    std::string routingengine_server; // routing engine server ip, or comma separated host[:port] list of its replicas
     std::string engine; // routing enginge used name engine name
+    std::unique_ptr<RoutingBackend> backend; // requests and answers of the engine, nullptr if unsupported
+    std::unique_ptr<EngineCache> engine_cache; // ETAs of the recent trips (snapped coordinates), nullptr if disabled
+    std::unique_ptr<SingleFlight> engine_flights; // engine calls in flight shared by identical requests, nullptr if disabled
+    size_t matrix_max_locations = 100; // max sources + targets per routing engine matrix call of a batch
+    double engine_deadline_ms = 0; // budget of a query for its engine call (from the start of the query), 0 for none
+    bool deadline_fallback_coarse = false; // answer the zone pair's median aggregate when the engine runs out of time, else -1
+    static constexpr double ENGINE_TIMED_OUT = -2.0; // os_eta of an engine call that ran out of time
+    static constexpr double ENGINE_LEADER_TIMED_OUT = -3.0; // handed to the coalesced callers when the leading call timed out (see retryAfterLeader)
 
     
     std::string zones_path_csv; // Path to the spatial zones of the dataset
-    GridIndex spatial_index;  // grid index on the zones 
-    std::vector<Zone> zones; // zones shapes
+    ZoneSnapshot zone_snapshot; // zones and spatial index loaded from the snapshot of the zones csv or parsed and built at startup
+    std::shared_ptr<const ZoneStore> zones; // zone shapes shared with the spatial index, declared before spatial_index and hash_index as they are built from them
+    std::unique_ptr<SpatialIndex> spatial_index;  // grid or quadtree index on the zones
+    HashIndex hash_index; // hash index of the coarse zone to zone od matrix on packed keys of the dense zone indices (position in zones)
+    std::unique_ptr<SpatialETAStore> spatial_tables; // SpatialETA tables (LRU pool of the mapped folder tables or a mapped archive)
+    size_t worker_threads = 0; // size of the worker pool, 0 for all the hardware threads
+    mutable std::mutex workers_mutex; // guards workers
+    mutable std::shared_ptr<WorkerPool> workers; // threads of ETAParallelRequest and the batch zone lookups, started on first use
+    // stages of ETARequestAsync: zoning, hash lookup and table mapping before the engine, rank search and FindStat after
+    // (the engine stage is the async engine clients' event loops), declared last and in this order so the pre-engine stage
+    // drains first on destruction (its tasks send engine calls), then the engine clients (their completions post to the
+    // post-engine stage), then the post-engine stage (its tasks use the tables and the hash index)
+    std::unique_ptr<Executor> post_engine;
+    std::unique_ptr<EngineReplicas> engine_replicas; // blocking and async clients of the routing engine servers, nullptr if unsupported
+    std::unique_ptr<Executor> pre_engine;
+    size_t prefetch_max_bytes = 1 << 20; // SpatialETA tables up to this size are prefetched while the engine answers
+
+    // the worker pool, started with worker_threads threads by the first call, the caller holds the returned copy
+    // for the duration of its loop so setWorkerThreads can replace the pool meanwhile
+    std::shared_ptr<WorkerPool> workerPool() const;
 
     // reading the hash index bin file of the coarse zone-to-zone OD matrix prepared from the offline phase
     void setup_hash_table(); 
 
-    // Zone the trip's start time
-    TimeZone timeZoning(const std::string& timestamp_str); 
+    // STEP 1: zone the query and get its ground truth aggregates, throws if it cannot be answered
+    // zones: the start and end zones of the query if already looked up (by zoneQueries)
+    void zoneQuery(const ETAQuery& query, ZonedQuery& zoned, const uint32_t* zones = nullptr) const;
 
-    // query the open source routing engine
+    // start and end zones of every query (start, end per query) with the batch lookup of the spatial index
+    std::vector<uint32_t> zoneQueries(const std::vector<ETAQuery>& queries) const;
+
+    // ETARequest with the zones of the query already looked up (nullptr to look them up)
+    double ETARequest(const ETAQuery& query, Timing& timing, const uint32_t* zones) const;
+
+    // STEP 2 and 3: rank os_eta in the SpatialETA table of the zone pair and map the rank to the aggregates
+    double outputETA(const ZonedQuery& zoned, double os_eta) const;
+    double outputETA(const ZonedQuery& zoned, const SpatialETATable& table, double os_eta) const; // table already mapped
+    double rankPercent(const SpatialETATable& table, double os_eta) const; // STEP 2: rank of os_eta in percent
+    double aggregateETA(const double* aggregates, double rank_percent) const; // STEP 3: aggregates interpolated at the rank
+
+    // ETASweepRequest of the time bits of the departure times (NO_TIME for a malformed one), timed from total_time_start
+    static constexpr uint64_t NO_TIME = UINT64_MAX;
+    std::vector<double> ETASweep(const ETAQuery& trip, const std::vector<uint64_t>& time_bits,
+                                 std::chrono::high_resolution_clock::time_point total_time_start, Timing& timing) const;
+
+    // query the open source routing engine, -1 on engine error, ENGINE_TIMED_OUT past the deadline
     double OpenSourceRoutingEngine( double start_long,  // start point longitude
                                     double start_lat,   // start point latitude
                                     double end_long,    // end point longitude
-                                    double end_lat);    // end point longitude
-    //http request method to the routing engine
-    std::string httpRequest(const std::string& host,    // server with routing engine ip
-                            int port,                   // port number
-                            const std::string& method,  // GET or POST
-                            const std::string& path,    // path of the request
-                            const std::string& body = ""); /// Body of the query if used
-
-    //parse the json result from the open source routing engine
-    double parseRoutingEngineAnswerJson(const std::string& json, // the open source routing engine json result 
-                                        const std::vector<std::string>& path);  // path to the result we need (ETA) which differs per engine
-
-    // binary search for OS_ETA in the spatial ETA table
-    SearchResult binarySearchETA(const std::string& zone1,
-                              const std::string& zone2,
-                              double os_eta);
-
-    // get ETA from the single record at position
-    double readETA( FILE* f,                // file pointer 
-                    long long record_idx);  // record index
+                                    double end_lat,     // end point longitude
+                                    HttpDeadline deadline = HttpDeadline::max()) const;
+
+    // one engine call of a route request without coalescing (blocking, or done on the engine client's event loop),
+    // -1 on engine error, ENGINE_TIMED_OUT past the deadline or on a read timeout
+    double routeCall(const EngineRequest& request, HttpDeadline deadline) const;
+    void routeCallAsync(const EngineRequest& request, HttpDeadline deadline, std::function<void(double)> done) const;
+
+    // whether a coalesced caller handed ENGINE_LEADER_TIMED_OUT still has time to call the engine once itself,
+    // else it answers ENGINE_TIMED_OUT (a caller without a deadline is not kept waiting on a stalled engine)
+    static bool retryAfterLeader(HttpDeadline deadline) {
+        return deadline != HttpDeadline::max() && std::chrono::steady_clock::now() < deadline;
+    }
+
+    // query the open source routing engine's matrix service for the ETAs from every source to every target
+    // (row major), -1 for the pairs without a route or if the engine call fails, ENGINE_TIMED_OUT past the deadline
+    std::vector<double> OpenSourceRoutingEngineMatrix(const std::vector<Point>& sources,
+                                                      const std::vector<Point>& targets,
+                                                      HttpDeadline deadline = HttpDeadline::max()) const;
+
+    // deadline of the engine call of a query started at start
+    HttpDeadline engineDeadline(std::chrono::steady_clock::time_point start) const;
+
+    // ETA of a query whose engine call ran out of time: the zone pair's median aggregate (deadline_fallback coarse),
+    // else throws
+    double deadlineFallback(const ZonedQuery& zoned) const;
+
+    static std::string flightKey(const EngineRequest& request); // identity of an engine call for the coalescing
+
+    // binary search for OS_ETA in the spatial ETA table of the zone pair
+    SearchResult binarySearchETA(const SpatialETATable& table,
+                              double os_eta) const;
     
     // get the aggregate values corresponding to the rank percentile of OS_ETA
-    StatResult FindStat(const std::vector<double>& x, // percentile ranks, e.g. {0, 25, 50, 75, 100}
-                        const std::vector<double>& y, // corresponding aggregate list / ETA values
-                        double rank_p);               // OS_ETA rank in percentage
+    StatResult FindStat(const double* x, // percentile ranks, e.g. {0, 25, 50, 75, 100}
+                        const double* y, // corresponding aggregate list / ETA values
+                        size_t n,        // number of ranks / values
+                        double rank_p) const; // OS_ETA rank in percentage
 
 
 
     public:
     // Constructor
-    CoarseETA(const std::string& spatialETA_path, // Spatial ETA tables folder path
+    CoarseETA(const std::string& spatialETA_path, // Spatial ETA tables folder path (or packed archive file)
               const std::string& hashTable_file, // Hash index bin file path
               const std::string& zones_path_csv, // zone shapes path in csv
               const std::string& routingengine_server, // routing engine server's ip
@@ -151,12 +198,133 @@ private:
               TimeZoningType time_zoning_type = TimeZoningType::DOW_HOD, // time zoning type with the default being day of week and hour of day
               int record_size = 8, // total single record size in the spatial eta table
               int eta_offset = 0); // eta offset in the single record
+    // bound the pool of mapped SpatialETA tables by the number of tables and the mapped megabytes
+    void setSpatialTableCache(size_t max_tables, size_t max_mb);
+
+    // in-memory search tree of up to max_levels (0 disables) for the SpatialETA tables of at least min_records
+    void setSpatialSearchTree(int max_levels, long long min_records);
+
+    // index of the zones for the spatial zoning: "grid" (the default, classified cells answering most points without
+    // a polygon test, grid_cells_per_degree 0 sizes them from the zones) or "quadtree" (split by zone density down to
+    // leaf_size zones per leaf). The zones and the index are kept in <zones csv>.snapshot, which the next start loads
+    // in a few ms as long as the csv is unchanged
+    void setSpatialIndex(const std::string& type, size_t leaf_size, int grid_cells_per_degree = 0);
+
+    // point in polygon kernel of the zoning: "auto" (the default, the widest SIMD the cpu supports), "scalar", "avx2"
+    // or "avx512", all give the same answers
+    void setPointInPolygonKernel(const std::string& kernel);
+
+    // temporal zoning of the start times: the season of every month from January ("4,4,1,1,1,2,2,2,3,3,3,4", the
+    // default), the hour ranges ("0-6,7-10,11-13,14-16,17-19,20-23", the default) and the local time zone of the
+    // ETAQuery::start_epoch times ("UTC", the default, or a tz database name such as "America/New_York"),
+    // they must match the ones the hash index was prepared with
+    void setTimeZoning(const std::string& seasons, const std::string& hour_ranges, const std::string& local_time_zone);
+
+    // number of keep-alive connections to the routing engine server (concurrent engine calls)
+    void setEnginePoolSize(size_t pool_size);
+
+    // cache up to max_entries routing engine ETAs (0 disables it, the default) keyed on the coordinates snapped to
+    // precision decimal places for ttl_seconds, a hit skips the engine call (Timing::routing_engine is then the lookup)
+    void setEngineCache(size_t max_entries, int precision, double ttl_seconds);
+    uint64_t engineCacheHits() const;
+    uint64_t engineCacheMisses() const;
+
+    // identical engine calls in flight at the same time wait for the first one and share its ETA (on by default)
+    void setEngineCoalescing(bool enabled);
+    uint64_t engineCoalescedCalls() const; // calls answered by another identical call
+
+    // max time of a connect to the routing engine and max silence of the engine while waiting for its answer
+    // (0 for none), past which the engine call fails like past its deadline
+    void setEngineTimeouts(int connect_timeout_ms, int read_timeout_ms);
+
+    // budget of a query for its routing engine call from the start of the query (0 for none, the default),
+    // the queries whose engine call runs out of time answer -1 (fallback "error") or the median aggregate of
+    // their zone pair without ranking (fallback "coarse")
+    void setEngineDeadline(double budget_ms, const std::string& fallback);
+
+    // with several routing engine servers, send a blocking engine call again to the next server once the first one
+    // has not answered after this percentile of the recent engine latencies (0 disables hedging, the default)
+    // a hedged call races the servers on their async clients instead of the blocking connection pools, so it shares
+    // the setAsyncPipeline connections and reads the whole answer (no early stop once the ETA is parsed), and a POST
+    // in flight on a connection that expires fails instead of being sent again
+    void setEngineHedging(double percentile);
+    uint64_t engineHedgedCalls() const;
+
+    // non-blocking connections and requests pipelined per connection of OpenSourceRoutingEngineAsync
+    void setEngineAsync(size_t max_connections, size_t pipeline_depth);
+
+    // threads of the pre-engine and post-engine stages of ETARequestAsync, and the largest SpatialETA table
+    // (in KB) prefetched while the engine answers (larger ones rely on their in-memory search tree)
+    void setAsyncPipeline(size_t pre_engine_threads, size_t post_engine_threads, size_t prefetch_kb);
+
+    // number of worker threads of ETAParallelRequest (0 for all the hardware threads), started on first use
+    // calls already running finish on the previous pool, which stops once the last of them returns
+    // each thread blocks on its routing engine call, so the engine pool size should be at least as large
+    void setWorkerThreads(size_t threads);
+
+    // max sources + targets per routing engine matrix call of ETABatchRequest (the engine's matrix size limit)
+    void setEngineMatrixLimit(size_t max_locations);
+
     // set the aggregate statistics type field 
     void setAggregateTypeField(const std::string& type);    
+
+    // keep only the aggregate type set by setAggregateTypeField ("compact") or all of them ("full") in the hash index
+    // stored in precision "f64", "f32" or "u16" (see AggregatePrecision for the error bounds)
+    void setAggregateStorage(const std::string& storage, const std::string& precision);
     
+    // The query methods below are const and thread-safe: the zones, the hash index and the routing engine settings
+    // are read only after setup, and the SpatialETA store and the engine connection pool synchronize internally.
+    // The set* methods above are setup only and must not run concurrently with queries
+
     // receive an ETA request and time the response time
     double ETARequest(ETAQuery query,    // ETA query of s, d, t
-                        Timing& timing); // compute the response time 
+                        Timing& timing) const; // compute the response time 
+
+    // answer an ETA request for an already known routing engine ETA (e.g. for offline evaluation)
+    double ETAFromEngineETA(const ETAQuery& query, // ETA query of s, d, t
+                            double os_eta) const;  // the routing engine's ETA of the query
+
+    // ETA profile of one trip over many departure times (e.g. the next 24 hours), the time of the trip query is ignored:
+    // the routing engine's ETA does not depend on the departure time, so the trip is zoned, sent to the engine and
+    // ranked in its SpatialETA table once, then only the hash lookup and FindStat run per departure time.
+    // The ETAs are in the order of the times (-1 for a malformed time, one without ground truth or on error)
+    std::vector<double> ETASweepRequest(const ETAQuery& trip, const std::vector<std::string>& start_datetimes,
+                                        Timing& timing) const;
+    std::vector<double> ETASweepRequest(const ETAQuery& trip, const std::vector<int64_t>& start_epochs, // Unix seconds
+                                        Timing& timing) const;
+
+    // answer a batch of ETA requests with routing engine matrix calls (OSRM table, ORS matrix, Valhalla sources_to_targets)
+    // grouping the distinct origins and destinations, the ETAs are in the order of the queries (-1 on error)
+    // with the engine cache on, the cached trips are answered from it and only the misses go into the matrix calls,
+    // whose routes are cached in turn
+    std::vector<double> ETABatchRequest(const std::vector<ETAQuery>& queries) const;
+    std::vector<double> ETABatchRequest(const std::vector<ETAQuery>& queries, // ETA queries of s, d, t
+                                        Timing& timing) const;                // response time of the whole batch
+
+    // query the open source routing engine without blocking, done(os_eta) runs on the engine client's
+    // event loop thread (keep it short), os_eta is -1 on engine error and -2 past the deadline as for the blocking call
+    void OpenSourceRoutingEngineAsync(double start_long, double start_lat, double end_long, double end_lat,
+                                      std::function<void(double)> done,
+                                      HttpDeadline deadline = HttpDeadline::max()) const;
+    std::future<double> OpenSourceRoutingEngineAsync(double start_long, double start_lat,
+                                                     double end_long, double end_lat,
+                                                     HttpDeadline deadline = HttpDeadline::max()) const;
+
+    // answer an ETA request without blocking: zoning and the hash lookup run on the pre-engine stage, which then
+    // sends the engine call and maps and prefetches the SpatialETA table while it is in flight, the rank search
+    // and FindStat run on the post-engine stage that calls done (the timing includes the queueing in the stages)
+    void ETARequestAsync(const ETAQuery& query, std::function<void(ETAResponse)> done) const;
+    std::future<ETAResponse> ETARequestAsync(const ETAQuery& query) const;
+
+    // dense zone indices of the points (ZoneStore::NO_ZONE outside the zones) with the batch lookup of the spatial index
+    // (Morton sorted, over the worker threads), in the order of the points
+    std::vector<uint32_t> zonePoints(const std::vector<Point>& points) const;
+    const std::string& zoneId(uint32_t zone_index) const { return zones->id(zone_index); }
+
+    // answer the queries with ETARequest spread over the worker threads (zoned together in a batch lookup first,
+    // which the per-query timings leave out), the ETAs (-1 on error) and the timings are in the order of the queries
+    std::vector<double> ETAParallelRequest(const std::vector<ETAQuery>& queries, // ETA queries of s, d, t
+                                           std::vector<Timing>& timings) const;  // response time of each query
 };
 
 #endif // COARSE_ETA_H
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef ENGINE_CACHE_H
+#define ENGINE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// Sharded, bounded cache of routing engine ETAs keyed on the trip's coordinates snapped to a grid of
+// 10^-precision degrees and the engine name (the engine's ETA does not depend on the departure time)
+// Each shard is an LRU under its own mutex holding max_entries / shards entries, entries expire after ttl
+class EngineCache {
+public:
+    struct Key {
+        int64_t start_long, start_lat, end_long, end_lat; // snapped coordinates
+        uint64_t engine;                                  // hash of the engine name
+        bool operator==(const Key& o) const {
+            return start_long == o.start_long && start_lat == o.start_lat &&
+                   end_long == o.end_long && end_lat == o.end_lat && engine == o.engine;
+        }
+    };
+
+    EngineCache(const std::string& engine, // engine name, part of every key
+                size_t max_entries,        // max cached trips over all the shards
+                int precision = 5,         // decimal places of the snapped coordinates (5 is ~1.1 m)
+                double ttl_seconds = 3600, // lifetime of an entry
+                size_t shards = 16);
+
+    Key key(double start_long, double start_lat, double end_long, double end_lat) const;
+
+    // ETA of the key if cached and not expired
+    bool find(const Key& key, double& eta);
+    void insert(const Key& key, double eta);
+
+    uint64_t hits() const { return hit_count.load(); }
+    uint64_t misses() const { return miss_count.load(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+    struct Entry {
+        double eta;
+        Clock::time_point expires;
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::pair<Key, Entry>> lru; // most recently used first
+        std::unordered_map<Key, std::list<std::pair<Key, Entry>>::iterator, KeyHash> entries;
+    };
+
+    uint64_t engine_tag;
+    double scale;               // 10^precision
+    size_t shard_capacity;
+    Clock::duration ttl;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint64_t> hit_count{0}, miss_count{0};
+
+    Shard& shardOf(const Key& key) { return *shards[KeyHash()(key) % shards.size()]; }
+};
+
+#endif // ENGINE_CACHE_H
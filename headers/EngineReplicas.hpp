@@ -0,0 +1,78 @@
+#ifndef ENGINE_REPLICAS_H
+#define ENGINE_REPLICAS_H
+
+#include "../headers/HttpClient.hpp"
+#include "../headers/AsyncHttpClient.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+
+// Replicas of the routing engine server, each with a pool of blocking keep-alive connections and an async client
+// Calls go round robin over the replicas and fall over to the next one when a replica fails while the deadline
+// allows. With hedging, a blocking call that has not been answered after the hedge percentile of the recent
+// engine latencies is sent again to the next replica and the first answer wins (the async calls only fall over)
+class EngineReplicas {
+public:
+    // servers: comma separated list of host[:port], the port defaulting to default_port
+    EngineReplicas(const std::string& servers, int default_port);
+    ~EngineReplicas();
+
+    EngineReplicas(const EngineReplicas&) = delete;
+    EngineReplicas& operator=(const EngineReplicas&) = delete;
+
+    void setPoolSize(size_t pool_size);                           // blocking connections per replica
+    void setAsync(size_t max_connections, size_t pipeline_depth); // async connections per replica
+    void setTimeouts(int connect_timeout_ms, int read_timeout_ms); // 0 for none
+    void setHedging(double percentile);                           // hedge delay percentile, 0 disables hedging
+                                                                  // (the hedged calls go through the async clients)
+
+    // response body of the request, throws HttpTimeout past the deadline or the error of the last replica tried
+    // (enough stops reading a large answer early, see HttpClient::request, ignored by the hedged calls as they race
+    // on the async clients, which read whole answers)
+    std::string call(const std::string& method, const std::string& path, const std::string& body,
+                     HttpDeadline deadline = HttpDeadline::max(), const HttpClient::BodyCheck& enough = nullptr);
+    void callAsync(const std::string& method, const std::string& path, const std::string& body,
+                   AsyncHttpClient::Callback done, HttpDeadline deadline = HttpDeadline::max());
+
+    size_t size() const { return replicas.size(); }
+    uint64_t hedgedCalls() const { return hedged.load(); } // calls sent to a second replica while the first was pending
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Replica {
+        std::string host;
+        int port;
+        std::unique_ptr<HttpClient> client;
+        std::unique_ptr<AsyncHttpClient> async_client;
+    };
+    struct AsyncCall; // a callAsync falling over the replicas
+
+    std::vector<Replica> replicas;
+    std::atomic<size_t> next{0};  // round robin
+    int connect_timeout_ms = 0;
+    int read_timeout_ms = 0;
+    size_t max_connections = 8, pipeline_depth = 16;
+    double hedge_percentile = 0;
+    std::atomic<uint64_t> hedged{0};
+
+    static const size_t LATENCY_WINDOW = 256;     // recent latencies of the hedge delay
+    static const size_t MIN_LATENCY_SAMPLES = 32; // no hedging before that many latencies
+    std::mutex latency_mutex;
+    std::vector<double> latencies; // ring of the last LATENCY_WINDOW call latencies in ms
+    size_t latency_count = 0;
+
+    std::shared_mutex lifecycle;   // the async fall over holds it shared while sending to the next replica
+    bool stopping = false;
+
+    void recordLatency(Clock::time_point start);
+    bool hedgeDelay(double& delay_ms); // false before MIN_LATENCY_SAMPLES latencies
+    std::string hedgedCall(size_t first, double delay_ms, const std::string& method, const std::string& path,
+                           const std::string& body, HttpDeadline deadline);
+    void sendAsync(std::shared_ptr<AsyncCall> call, size_t attempt);
+};
+
+#endif // ENGINE_REPLICAS_H
@@ -0,0 +1,39 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of threads running posted tasks in FIFO order, the threads start with the first task
+// Used as the executor of one stage of the async query pipeline
+class Executor {
+public:
+    explicit Executor(size_t threads = 1);
+    ~Executor(); // runs the tasks already posted, then joins the threads
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // queue the task (thread-safe), tasks must not throw
+    void post(std::function<void()> task);
+
+    size_t size() const { return thread_count; }
+
+private:
+    size_t thread_count;
+    std::vector<std::thread> threads;
+    std::once_flag started;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+
+    void start();
+    void work();
+};
+
+#endif // EXECUTOR_H
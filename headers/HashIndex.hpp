@@ -0,0 +1,249 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include "../headers/MappedFile.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <unordered_map>
+
+// Type of time zoning to use
+enum TimeZoningType {
+    DOW_HOD = 0,
+    DAYTYPE_HOD = 1,
+    DOW_RANGE = 2,
+    DAYTYPE_RANGE = 3
+};
+
+// Aggregate lists stored per entry, ALL_FIELDS is 2 (min_max) + 3 (min_med_max) + 5 (percentiles) values
+enum AggregateField {
+    ALL_FIELDS = 0,
+    MIN_MAX = 1,      // [0,100]
+    MIN_MED_MAX = 2,  // [0,50,100]
+    PERCENTILES = 3   // [0,25,50,75,100]
+};
+
+// Storage precision of the aggregate values (ETAs in seconds)
+//   F64:         exact
+//   F32:         float32, relative error <= 2^-24 (below 0.006 s for any ETA under 1e5 s)
+//   U16_SECONDS: rounded to whole seconds in a uint16, absolute error <= 0.5 s for values in [0, 65535] s (~18.2 h),
+//                values outside that range are clamped to it (counted and reported when compacting)
+enum AggregatePrecision {
+    F64 = 0,
+    F32 = 1,
+    U16_SECONDS = 2
+};
+
+// Packed 64-bit key of the hash index of the coarse zone-to-zone OD matrix
+// | unused (8) | zone1 (20) | zone2 (20) | season (3) | day (3) | hour1 (5) | hour2 (5) |
+// day is the day of week (0-6) for DOW_* or the daytype (0 weekday, 1 weekend) for DAYTYPE_*
+// hour1 is the adjusted hour for *_HOD, or hour1/hour2 are the start/end of the hour range for *_RANGE
+struct HashKey {
+    static constexpr uint64_t EMPTY = ~0ULL;          // never produced by pack() as the top 8 bits are always 0
+    static constexpr uint32_t MAX_ZONES = 1u << 20;   // dense zone ids must be below this
+
+    // the time zone part of the key (lower 16 bits), throws std::out_of_range if a field does not fit its bits
+    static uint64_t timeBits(int season, int day, int hour1, int hour2) {
+        if (season < 0 || season > 7 || day < 0 || day > 7 || hour1 < 0 || hour1 > 31 || hour2 < 0 || hour2 > 31)
+            throw std::out_of_range("Hash key time field out of range: season " + std::to_string(season) +
+                                    ", day " + std::to_string(day) + ", hours " + std::to_string(hour1) + "-" +
+                                    std::to_string(hour2) + "\nShould be season 0-7, day 0-7 and hours 0-31\n");
+        return (uint64_t(season) << 13) | (uint64_t(day) << 10) | (uint64_t(hour1) << 5) | uint64_t(hour2);
+    }
+
+    static uint64_t pack(uint32_t zone1, uint32_t zone2, uint64_t time_bits) {
+        return (uint64_t(zone1) << 36) | (uint64_t(zone2) << 16) | time_bits;
+    }
+
+    // throws std::out_of_range if a zone is not below MAX_ZONES or a time field does not fit its bits
+    static uint64_t pack(uint32_t zone1, uint32_t zone2,
+                         int season, int day, int hour1, int hour2) {
+        if (zone1 >= MAX_ZONES || zone2 >= MAX_ZONES)
+            throw std::out_of_range("Hash key zone out of range: " + std::to_string(zone1) + ", " +
+                                    std::to_string(zone2) + "\nShould be below " + std::to_string(MAX_ZONES) + "\n");
+        return pack(zone1, zone2, timeBits(season, day, hour1, hour2));
+    }
+};
+
+// Open addressing hash table (linear probing, power of 2 capacity) from packed keys to entry indices
+// The slots are either owned (built with insert) or attached to external memory (e.g. a mapped file)
+class FlatHashIndex {
+public:
+    struct Slot {
+        uint64_t key;    // packed key or HashKey::EMPTY
+        uint64_t value;  // index of the entry's aggregates
+    };
+
+    // size the table for n entries while keeping the load factor at most 1/2
+    void reserve(size_t n);
+
+    // insert or overwrite the value of key
+    void insert(uint64_t key, uint64_t value);
+
+    // use the capacity slots at data (capacity a power of 2) without copying them
+    void attach(const Slot* data, size_t capacity, size_t entries);
+
+    // slot holding key or nullptr if the key is not in the table
+    const Slot* find(uint64_t key) const {
+        if (!table) return nullptr;
+        for (uint64_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            const Slot& s = table[i];
+            if (s.key == key) return &s;
+            if (s.key == HashKey::EMPTY) return nullptr;
+        }
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return table ? mask + 1 : 0; }
+    const Slot* data() const { return table; }
+
+    // 64-bit mixer (splitmix64 finalizer) so the packed bit fields spread over the whole table
+    static uint64_t hash(uint64_t key) {
+        key ^= key >> 30; key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27; key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+private:
+    std::vector<Slot> slots;       // owned slots
+    const Slot* table = nullptr;   // slots in use (owned or attached)
+    uint64_t mask = 0;
+    size_t count = 0;
+};
+
+// Header of the v3 hash index file, followed by 8-byte aligned sections:
+//   zones:  num_zones x { uint32 length, chars } (the zone ids of the dense zone indices in the keys)
+//   slots:  capacity x FlatHashIndex::Slot (the open addressing table, queried in place)
+//   values: num_entries x values_per_entry values of the precision (contiguous aggregate block indexed by Slot::value)
+// v2 files have the same layout without the last two header fields and always store ALL_FIELDS in F64
+// The v1 file is { uint64 num_entries, num_entries x { uint32 key_len, key chars, 10 doubles } }
+struct HashIndexHeader {
+    char     magic[8];          // HashIndex::MAGIC
+    uint32_t version;           // 3 (or 2)
+    uint32_t time_zoning_type;  // TimeZoningType of the keys
+    uint64_t num_entries;
+    uint64_t capacity;          // number of slots (power of 2)
+    uint32_t num_zones;
+    uint32_t values_per_entry;  // values per entry in the values block (stride)
+    uint64_t zones_offset;      // byte offsets of the sections from the start of the file
+    uint64_t slots_offset;
+    uint64_t values_offset;
+    uint32_t aggregate_field;   // AggregateField stored per entry (v3)
+    uint32_t precision;         // AggregatePrecision of the values (v3)
+};
+
+// Hash index of the coarse zone-to-zone OD matrix loaded from a v1 file (parsed into memory)
+// or a v2 file (memory mapped and queried in place)
+class HashIndex {
+public:
+    static constexpr char MAGIC[8] = {'C', 'E', 'T', 'A', 'H', 'I', 'D', 'X'};
+    static constexpr uint32_t VERSION = 3;
+    static constexpr uint32_t VALUES_PER_ENTRY = 10; // 2 (min_max) + 3 (min_med_max) + 5 (percentiles)
+    static constexpr size_t MAX_FIELD_VALUES = 5;    // values of the largest aggregate list
+
+    // zone_ids are the runtime zones in the order of their dense indices, an empty list
+    // interns every zone found in the keys instead of skipping the unknown ones (used for converting)
+    HashIndex(TimeZoningType time_zoning_type, const std::vector<std::string>& zone_ids = {});
+
+    // load a v1, v2 or v3 hash index file (detected by the magic)
+    void load(const std::string& path);
+
+    // write the loaded index as a v3 file
+    void save(const std::string& path) const;
+
+    // keep only the aggregate list of field (or ALL_FIELDS) stored in precision in one flat block
+    // only for indexes loaded into memory (v1 files) in full F64, mapped files are compacted by the converter
+    void compact(AggregateField field, AggregatePrecision precision);
+
+    // decode the aggregate list of field of the runtime zone pair and time bits into out (MAX_FIELD_VALUES)
+    // returns the number of values or 0 if the key is missing or field is ALL_FIELDS (more than MAX_FIELD_VALUES)
+    size_t find(uint32_t zone1, uint32_t zone2, uint64_t time_bits, AggregateField field, double* out) const {
+        if (field == ALL_FIELDS) return 0;
+        if (zone1 >= zone_remap.size() || zone2 >= zone_remap.size()) return 0;
+        uint32_t key_zone1 = zone_remap[zone1], key_zone2 = zone_remap[zone2];
+        if (key_zone1 == NO_ZONE || key_zone2 == NO_ZONE) return 0;
+        const FlatHashIndex::Slot* slot = table.find(HashKey::pack(key_zone1, key_zone2, time_bits));
+        if (!slot) return 0;
+
+        size_t offset = (stored_field == ALL_FIELDS) ? fieldOffset(field) : 0;
+        size_t count = fieldCount(field);
+        decode(values + slot->value * entry_bytes, offset, count, out);
+        return count;
+    }
+
+    // whether the aggregate list of field is stored
+    bool hasField(AggregateField field) const { return stored_field == ALL_FIELDS || stored_field == field; }
+
+    size_t size() const { return table.size(); }
+    bool isMapped() const { return file.isOpen(); }
+
+    static AggregateField parseAggregateField(const std::string& name);       // "all", "min_max", "min_med_max" or "percentiles"
+    static AggregatePrecision parseAggregatePrecision(const std::string& name); // "f64", "f32" or "u16"
+
+    // position and length of the aggregate list of field in the ALL_FIELDS layout
+    static size_t fieldOffset(AggregateField field) {
+        static const size_t offsets[] = {0, 0, 2, 5};
+        return offsets[field];
+    }
+    static size_t fieldCount(AggregateField field) {
+        static const size_t counts[] = {VALUES_PER_ENTRY, 2, 3, 5};
+        return counts[field];
+    }
+    static size_t precisionBytes(AggregatePrecision precision) {
+        static const size_t bytes[] = {8, 4, 2};
+        return bytes[precision];
+    }
+
+private:
+    TimeZoningType time_zoning_type;
+    std::vector<std::string> runtime_zones;               // zone ids of the runtime zone indices
+    bool intern_zones;                                    // intern unknown zones of the keys (no runtime zones given)
+    std::vector<std::string> zone_names;                  // zone ids of the dense zone indices in the keys
+    std::unordered_map<std::string, uint32_t> zone_lookup; // zone id -> dense zone index in the keys
+    std::vector<uint32_t> zone_remap;                     // runtime zone index -> dense zone index in the keys
+    static constexpr uint32_t NO_ZONE = ~0u;              // runtime zone without any key
+
+    FlatHashIndex table;            // packed key -> entry index
+    AggregateField stored_field = ALL_FIELDS;   // aggregate lists stored per entry
+    AggregatePrecision precision = F64;         // precision of the stored values
+    size_t entry_bytes = VALUES_PER_ENTRY * 8;  // bytes per entry in the values block
+    std::vector<char> owned_values; // values block of a v1 file
+    const char* values = nullptr;   // values block in use (owned or mapped)
+    MappedFile file;                // mapping of a v2/v3 file
+
+    void loadV1(const std::string& path);
+    void loadV2(const std::string& path);
+
+    // parse a v1 key "zone1,zone2,season,day,hour[,end_hour]" into its packed form, false if malformed (a field that
+    // is not an integer in the range of its key bits) or unknown zone
+    bool packKey(const std::string& key, uint64_t& packed);
+
+    // decode count values starting at value offset of an entry into out
+    void decode(const char* entry, size_t offset, size_t count, double* out) const {
+        switch (precision) {
+            case F64:
+                memcpy(out, entry + offset * sizeof(double), count * sizeof(double));
+                break;
+            case F32:
+                for (size_t i = 0; i < count; i++) {
+                    float v;
+                    memcpy(&v, entry + (offset + i) * sizeof(float), sizeof(float));
+                    out[i] = v;
+                }
+                break;
+            case U16_SECONDS:
+                for (size_t i = 0; i < count; i++) {
+                    uint16_t v;
+                    memcpy(&v, entry + (offset + i) * sizeof(uint16_t), sizeof(uint16_t));
+                    out[i] = v;
+                }
+                break;
+        }
+    }
+};
+
+#endif // HASH_INDEX_H
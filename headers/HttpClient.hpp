@@ -0,0 +1,115 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <sys/socket.h>
+
+// time by which a request must be answered, HttpDeadline::max() for none
+using HttpDeadline = std::chrono::steady_clock::time_point;
+
+// thrown when a request runs out of time (its deadline, the connect timeout or the read timeout)
+struct HttpTimeout : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+struct HttpResponse {
+    int status = 0;
+    std::string body;
+    bool keep_alive = false; // the connection can carry the next response
+};
+
+// Parser of the HTTP/1.x responses read from a connection, framed by Content-Length,
+// chunked transfer encoding or (without either) the end of the connection
+class HttpResponseParser {
+public:
+    // parse the response at the front of buffer, false if it is not complete yet,
+    // else its bytes are erased from buffer (the next pipelined response starts there)
+    // eof tells that the connection was closed after the bytes in buffer
+    // (a response filling the whole buffer is moved into the body without copying it)
+    static bool parse(std::string& buffer, HttpResponse& response, bool eof = false);
+
+    // the body bytes received so far of the Content-Length framed response at the front of buffer and the
+    // number of bytes still missing, false if its headers are not complete or it is framed otherwise
+    static bool partialBody(const std::string& buffer, std::string_view& body, size_t& missing);
+};
+
+// HTTP/1.1 client with a pool of persistent keep-alive connections to one server (host:port)
+// The address is resolved once (getaddrinfo), responses are framed by Content-Length or chunked
+// transfer encoding, and requests on a connection the server has closed meanwhile are retried
+// until a fresh connection fails. Thread-safe: at most pool_size connections are open, extra callers wait
+// Every wait (for a pooled connection, the connect, each read) is bounded by the request's deadline and
+// the connect / read timeouts, past which HttpTimeout is thrown
+class HttpClient {
+public:
+    HttpClient(const std::string& host, int port, size_t pool_size = 4);
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    // max time of a connect and max silence of the server while waiting for a response, 0 for none (the default)
+    void setTimeouts(int connect_timeout_ms, int read_timeout_ms);
+
+    // true once the body received so far holds what the caller needs
+    using BodyCheck = std::function<bool(std::string_view body)>;
+    static const size_t EARLY_STOP_MIN_BYTES = 64 << 10; // smaller remainders are read (the connection is kept)
+
+    // send the request and return the response body, throws if the server cannot be reached or the response is malformed
+    // with enough, the reading of a Content-Length body stops once enough(body so far) holds while at least
+    // EARLY_STOP_MIN_BYTES are missing (checked each time the received body doubles), the returned body is then
+    // truncated and the connection closed instead of drained
+    std::string request(const std::string& method,     // GET or POST
+                        const std::string& path,       // path of the request
+                        const std::string& body = "",  // json body of a POST
+                        HttpDeadline deadline = HttpDeadline::max(), // HttpTimeout past it
+                        const BodyCheck& enough = nullptr);
+
+    size_t connectionsOpened() const { return opened.load(); } // connections opened so far (to check the reuse)
+
+    // the HTTP/1.1 request bytes (json body for a POST)
+    static std::string buildRequest(const std::string& host, const std::string& method,
+                                    const std::string& path, const std::string& body);
+
+    // ack the next segments at once (TCP_QUICKACK is cleared by the kernel, re-arm it before every read)
+    static void quickAck(int sock);
+
+    // poll timeout in ms until the earlier of deadline and now + timeout_ms (0 for no timeout), -1 if neither is set
+    static int pollTimeout(HttpDeadline deadline, int timeout_ms);
+
+private:
+    std::string host;
+    int port;
+    size_t pool_size;
+    int connect_timeout_ms = 0;
+    int read_timeout_ms = 0;
+
+    std::once_flag resolved;          // resolve the host on the first request (retried if it failed)
+    sockaddr_storage addr{};
+    socklen_t addr_len = 0;
+
+    std::mutex mutex;
+    std::condition_variable available;
+    std::vector<int> idle;            // connected sockets ready for a request
+    size_t open_count = 0;            // idle + in use sockets
+    std::atomic<size_t> opened{0};
+
+    void resolve();
+    int connectSocket(HttpDeadline deadline);
+    int acquire(bool& reused, HttpDeadline deadline); // an idle connection or a new one if the pool is not full
+    void release(int sock, bool keep); // return the connection to the pool or close it
+
+    // send the request and read one response on sock, keep_alive is false if the server closes the connection
+    // returns false if the connection was closed before any response byte (stale keep-alive connection)
+    bool exchange(int sock, const std::string& request, std::string& body, bool& keep_alive, HttpDeadline deadline,
+                  const BodyCheck& enough);
+};
+
+#endif // HTTP_CLIENT_H
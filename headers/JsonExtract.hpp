@@ -0,0 +1,38 @@
+#ifndef JSON_EXTRACT_H
+#define JSON_EXTRACT_H
+
+#include <string_view>
+#include <cstddef>
+
+// Single-pass, allocation-free extraction of values from a JSON document in place (e.g. the receive buffer)
+// A path is a '/' separated list of object keys and array indices ("routes/0/duration"). The walk skips the
+// values off the path without parsing them and stops at the target, so the rest of the document (geometry,
+// legs, ...) is never scanned; numbers are parsed with std::from_chars
+class JsonExtract {
+public:
+    enum Status {
+        FOUND,      // the value is at the path
+        NOT_FOUND,  // the document has no such path (or the value is not a number, e.g. null)
+        INCOMPLETE, // the document ends before the path is resolved (a partial buffer, read on)
+        MALFORMED   // not JSON
+    };
+
+    // offset of the value at path in json
+    static Status locate(std::string_view json, std::string_view path, size_t& offset);
+
+    // the number at path in json
+    static Status number(std::string_view json, std::string_view path, double& value);
+
+    // the number at json[offset] (after whitespace), offset is moved past it (NOT_FOUND for null or another value)
+    static Status parseNumber(std::string_view json, size_t& offset, double& value);
+
+    // move offset past the value at json[offset] (after whitespace)
+    static Status skipValue(std::string_view json, size_t& offset);
+
+    static void skipSpace(std::string_view json, size_t& offset) {
+        while (offset < json.size() && (json[offset] == ' ' || json[offset] == '\n' || json[offset] == '\r' || json[offset] == '\t'))
+            offset++;
+    }
+};
+
+#endif // JSON_EXTRACT_H
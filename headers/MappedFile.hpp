@@ -0,0 +1,32 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file (unmapped on destruction)
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path); // map the file, throws if it cannot be opened or mapped
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return static_cast<const char*>(addr); }
+    size_t size() const { return length; }
+    bool isOpen() const { return addr != nullptr; }
+
+    // madvise the bytes [offset, offset + len) of the mapping (clipped to the file), e.g. MADV_RANDOM or MADV_WILLNEED
+    void advise(int advice, size_t offset = 0, size_t len = ~size_t(0)) const;
+
+private:
+    void* addr = nullptr;  // start of the mapping or nullptr (also for empty files)
+    size_t length = 0;     // mapped bytes
+    void unmap();
+};
+
+#endif // MAPPED_FILE_H
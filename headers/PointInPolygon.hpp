@@ -0,0 +1,42 @@
+#ifndef POINT_IN_POLYGON_H
+#define POINT_IN_POLYGON_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Edges of polygon rings in structure of arrays layout for the ray casting kernels: the start vertex (xi, yi),
+// the end latitude yj and the precomputed differences dx = xj - xi, dy = yj - yi (the exact values the scalar
+// ray casting computes per edge, so the kernels keep its division and its results bit for bit)
+struct EdgeArrays {
+    std::vector<double> xi, yi, yj, dx, dy;
+
+    size_t size() const { return xi.size(); }
+    // edge from vertices[i] = (xi, yi) to vertices[j] = (xj, yj) of the ray casting loop
+    void add(double xi, double yi, double xj, double yj);
+    void clear();
+};
+
+// Ray casting kernels over EdgeArrays: the parity of the edges straddling the point's latitude whose crossing
+// is east of the point, with the arithmetic of Polygon::contains. The AVX-512 (8 edges) and AVX2 (4 edges)
+// kernels are picked at runtime from what the cpu supports, the scalar one is the fallback
+class PointInPolygon {
+public:
+    // true if the ray from (lon, lat) towards +lon crosses an odd number of the edges [begin, end)
+    static bool crossings(const EdgeArrays& edges, size_t begin, size_t end, double lon, double lat) {
+        return kernel(edges, begin, end, lon, lat);
+    }
+
+    // "auto" (the widest the cpu supports, the default), "scalar", "avx2" or "avx512", throws if the cpu lacks it
+    // set before the queries, the kernel is shared by all the polygons
+    static void select(const std::string& name);
+    static std::string selected();
+    static std::vector<std::string> available(); // kernels the cpu supports
+
+private:
+    using Kernel = bool (*)(const EdgeArrays&, size_t, size_t, double, double);
+    static Kernel kernel;
+    static std::string kernel_name;
+};
+
+#endif // POINT_IN_POLYGON_H
@@ -3,6 +3,7 @@
 #define READ_ZONES_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <cstdint>
@@ -12,6 +13,10 @@
 #include <iostream>
 #include <algorithm>
 #include <sstream>
+#include "../headers/PointInPolygon.hpp"
+#include "../headers/WorkerPool.hpp"
+#include <memory>
+#include <stdexcept>
 
 struct Point {
     double lon, lat;
@@ -41,6 +46,7 @@ struct BBox {
 
 struct Polygon {
     std::vector<Point> vertices;
+
     bool contains(const Point& p) const {
         // Ray casting algorithm for point-in-polygon check
         bool inside = false;
@@ -76,47 +82,206 @@ struct Zone {
     }
 };
 
+struct WKTCursor;
+class SnapshotWriter;
+class SnapshotReader;
+
 class WKTParser {
 public:
-    static std::vector<Zone> parseCSV(const std::string& filename); // parse csv of zones in the schema of <zone_id, geometry> 
+    // parse csv of zones in the schema of <zone_id, geometry> (POLYGON or MULTIPOLYGON WKT, the holes are ignored)
+    // the file is mapped and its lines parsed in blocks over threads workers (0 for all the hardware threads),
+    // the zones keep the order of the lines, a line that fails to parse is skipped with a warning
+    static std::vector<Zone> parseCSV(const std::string& filename, size_t threads = 0);
 private:
 
-    static std::string trimQuotes(const std::string& str);
-    static std::string trim(const std::string& str);
-    static size_t findMatchingParen(const std::string& str, size_t start_pos);
-
-    static bool parseWKTGeometry(const std::string& wkt, Zone& zone);
-    static bool parseMultiPolygon(const std::string& wkt, Zone& zone);
-    static bool parsePolygon(const std::string& wkt, Zone& zone);
+    static bool parseLine(std::string_view line, size_t line_number, Zone& zone, std::string& warning);
+    static bool parsePolygon(WKTCursor& wkt, Zone& zone); // ((ring), ...) at the cursor
     static bool pointsEqual(const Point& p1, const Point& p2, double epsilon = 1e-9);
-    static Polygon parseSinglePolygonString(const std::string& poly_str);
 
     static void computeBBox(Zone& zone);
 };
 
-class GridIndex {
-    struct Cell {
-        std::vector<int> zone_indices;  // zones that intersect this grid cell
+// Read-only store of the parsed zones shared by the spatial index and CoarseETA, addressed by the dense zone index
+// (the position of the zone in the csv): the vertices of all the polygons in one flat array, their edges in one
+// EdgeArrays for the ray casting kernels (edge k starts at vertex k), a polygon is a range of them and a zone a range
+// of polygons. The zone ids are only needed at the edges (file names, hash index keys, output)
+class ZoneStore {
+public:
+    static constexpr uint32_t NO_ZONE = UINT32_MAX; // a point outside every zone
+
+    explicit ZoneStore(const std::vector<Zone>& zones);
+    explicit ZoneStore(SnapshotReader& in); // as written by save
+    void save(SnapshotWriter& out) const;
+
+    struct PolygonRange {
+        uint32_t begin, end; // its vertices and edges
     };
-    
-    std::vector<std::vector<Cell>> grid;
+
+    size_t size() const { return zone_bboxes.size(); }
+    const std::string& id(uint32_t zone) const { return zone_ids[zone]; }
+    const std::vector<std::string>& ids() const { return zone_ids; }
+    const BBox& bbox(uint32_t zone) const { return zone_bboxes[zone]; }
+    uint32_t polygonBegin(uint32_t zone) const { return zone_polygons[zone]; }
+    uint32_t polygonEnd(uint32_t zone) const { return zone_polygons[zone + 1]; }
+    const PolygonRange& polygon(uint32_t polygon) const { return polygons[polygon]; }
+    const Point& vertex(uint32_t vertex) const { return vertices[vertex]; }
+    size_t vertexCount() const { return vertices.size(); }
+
+    // Polygon::contains of the polygon with the selected PointInPolygon kernel (same answers bit for bit)
+    bool polygonContains(uint32_t polygon, const Point& p) const {
+        const PolygonRange& range = polygons[polygon];
+        if (range.end - range.begin < 3) return false;
+        return PointInPolygon::crossings(edges, range.begin, range.end, p.lon, p.lat);
+    }
+    // Zone::containsPoint of the zone
+    bool containsPoint(uint32_t zone, const Point& p) const {
+        if (!zone_bboxes[zone].contains(p)) return false;
+        for (uint32_t k = zone_polygons[zone]; k < zone_polygons[zone + 1]; k++)
+            if (polygonContains(k, p)) return true;
+        return false;
+    }
+
+private:
+    std::vector<std::string> zone_ids;
+    std::vector<BBox> zone_bboxes;
+    std::vector<uint32_t> zone_polygons; // polygons of zone z are [zone_polygons[z], zone_polygons[z + 1])
+    std::vector<PolygonRange> polygons;
+    std::vector<Point> vertices;
+    EdgeArrays edges;
+};
+
+// Index of the zones answering which zone holds a point: the first zone (in the indexed order) whose polygons
+// contain it among the zones whose bounding box holds it, so every index returns the same zone
+class SpatialIndex {
+public:
+    explicit SpatialIndex(std::shared_ptr<const ZoneStore> z) : zones(std::move(z)) {}
+    virtual ~SpatialIndex() = default;
+
+    const std::string& findZoneContainingPoint(double lon, double lat) const; // id of the zone, empty if none
+    virtual uint32_t findZoneIndex(double lon, double lat) const = 0; // dense zone index or ZoneStore::NO_ZONE
+    virtual size_t candidates(double lon, double lat) const = 0; // zones tested by a lookup of the point
+
+    // findZoneIndex of n points into zone_indices (in the order of the points): the points are looked up in
+    // Morton order of their coordinates, so the points of a cell run together while its zones are in cache,
+    // in blocks spread over the workers if any
+    void findZoneIndices(const double* lon, const double* lat, size_t n, uint32_t* zone_indices,
+                         WorkerPool* workers = nullptr) const;
+
+    // "grid" (GridIndex with cells_per_degree, 0 for auto) or "quadtree" (QuadTreeIndex with leaf_size),
+    // throws on an unknown type
+    static std::unique_ptr<SpatialIndex> create(const std::string& type, std::shared_ptr<const ZoneStore> zones,
+                                                size_t leaf_size = 8, int cells_per_degree = 0);
+
+    // the built index for a ZoneSnapshot (throws if the index cannot be saved) and the index of type read back
+    virtual void save(SnapshotWriter& out) const;
+    static std::unique_ptr<SpatialIndex> load(const std::string& type, std::shared_ptr<const ZoneStore> zones,
+                                              SnapshotReader& in);
+
+    const ZoneStore& store() const { return *zones; }
+
+protected:
+    std::shared_ptr<const ZoneStore> zones;
+};
+
+// Uniform grid over the zones whose cells are classified once: a cell covered by one zone (the first zone holding
+// its points) or empty answers without any polygon test, only the boundary cells test the zones that are not
+// constant over them, and only against the edges of their polygons that can flip the ray casting inside the cell
+// (the edges crossing the cell, plus the latitudes where the edges to its right start or end within its row),
+// so the answers are the ones of ZoneStore::containsPoint bit for bit
+// cells_per_degree 0 picks the resolution from the zone sizes (about 8 cells across the small zones)
+class GridIndex : public SpatialIndex {
+public:
+    GridIndex(std::shared_ptr<const ZoneStore> z, int cells_per_degree = 0);
+    GridIndex(std::shared_ptr<const ZoneStore> z, SnapshotReader& in);
+    uint32_t findZoneIndex(double lon, double lat) const override;
+    size_t candidates(double lon, double lat) const override;
+    void save(SnapshotWriter& out) const override;
+
+    int cellsPerDegree() const { return cells_per_degree; }
+    size_t coveredCells() const { return covered_count; }
+    size_t emptyCells() const { return empty_count; }
+    size_t boundaryCells() const { return boundary.size(); }
+
+private:
+    static constexpr uint32_t EMPTY = 0u << 30, COVERED = 1u << 30, BOUNDARY = 2u << 30, KIND = 3u << 30;
+    static constexpr double CELL_MARGIN = 1e-9; // degrees around a cell, far above the rounding of the cell lookup
+    static constexpr size_t MAX_CELLS = 1 << 22;
+
+    struct Edge {
+        double xi, yi, xj, yj; // in the order of the ray casting loop (vertices[i], vertices[j])
+    };
+    struct CellPolygon {       // ray casting of a polygon over a boundary cell
+        uint32_t edge_begin, edge_end;     // edges crossing the cell
+        uint32_t toggle_begin, toggle_end; // latitudes within the row where the edges right of the cell start or end
+        bool parity;           // of the edges right of the cell that straddle its whole row
+    };
+    struct CellZone {          // zone that is not constant over a boundary cell
+        uint32_t zone;
+        uint32_t polygon_begin, polygon_end; // its polygons that are not outside the whole cell
+    };
+    struct BoundaryCell {
+        uint32_t zone_begin, zone_end; // zones to test in index order
+        uint32_t fallback;     // zone covering the rest of the cell, ZoneStore::NO_ZONE if none
+    };
+
     double min_lon, max_lon, min_lat, max_lat;
+    int cells_per_degree;
     int grid_size_x, grid_size_y;
     double cell_width, cell_height;
-    std::vector<Zone> zones;
-    
-public:
-    GridIndex(const std::vector<Zone>& z, int cells_per_degree = 10);    
-    std::string findZoneContainingPoint(double lon, double lat);
-    
-private:
-    int getGridX(double lon) {
+    std::vector<uint32_t> cells;   // row major: the kind in the top bits, the zone or the boundary cell below
+    std::vector<BoundaryCell> boundary;
+    std::vector<CellZone> cell_zones;
+    std::vector<CellPolygon> cell_polygons;
+    EdgeArrays edges;
+    std::vector<double> toggles;
+    size_t covered_count = 0, empty_count = 0;
+
+    static int autoResolution(const ZoneStore& zones);
+    void classify();
+
+    int getGridX(double lon) const {
         return static_cast<int>((lon - min_lon) / cell_width);
     }
     
-    int getGridY(double lat) {
+    int getGridY(double lat) const {
         return static_cast<int>((lat - min_lat) / cell_height);
     }
+
+    bool polygonContains(const CellPolygon& polygon, const Point& p) const;
+};
+
+// Quadtree on the zone bounding boxes split by zone density: a node holding more than leaf_size zones is split
+// into its 4 quadrants (a zone goes to every quadrant its bounding box meets) until max_depth, so dense downtown
+// areas get small leaves and sparse suburbs large ones, and a lookup tests about leaf_size zones wherever it lands
+// Nodes are kept flat (the 4 children of a node are consecutive) and a leaf lists its zones in index order
+class QuadTreeIndex : public SpatialIndex {
+public:
+    QuadTreeIndex(std::shared_ptr<const ZoneStore> z, size_t leaf_size = 8, int max_depth = 16);
+    QuadTreeIndex(std::shared_ptr<const ZoneStore> z, SnapshotReader& in);
+    uint32_t findZoneIndex(double lon, double lat) const override;
+    size_t candidates(double lon, double lat) const override;
+    void save(SnapshotWriter& out) const override;
+
+    size_t leaves() const { return leaf_count; }
+    int depth() const { return max_reached; }
+
+private:
+    struct Node {
+        double mid_lon, mid_lat;   // split point of an inner node
+        int32_t child = -1;        // first of the 4 children (west-south, east-south, west-north, east-north), -1 for a leaf
+        uint32_t begin = 0, end = 0; // zones of a leaf in leaf_zones
+    };
+
+    std::vector<Node> nodes;       // nodes[0] is the root
+    std::vector<uint32_t> leaf_zones;
+    BBox bounds;                   // of all the zones
+    size_t leaf_size;
+    int max_depth;
+    size_t leaf_count = 0;
+    int max_reached = 0;
+
+    void split(size_t node, const BBox& box, std::vector<uint32_t> node_zones, int depth);
+    const Node& leafOf(double lon, double lat) const; // leaf holding the point, inside bounds
 };
 
 #endif // READ_ZONES_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef ROUTING_BACKEND_H
+#define ROUTING_BACKEND_H
+
+#include "../headers/ReadZones.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <memory>
+#include <unordered_map>
+
+// HTTP request of a routing engine service
+struct EngineRequest {
+    std::string method, path, body;
+};
+
+// Routing engine behind CoarseETA: the requests of its route and matrix services and the parsing of their
+// answers for the engines served over HTTP, or the answers themselves for the in-process ones
+// A new engine derives from it and is named in create, the query path only goes through this interface
+class RoutingBackend {
+public:
+    virtual ~RoutingBackend() = default;
+
+    virtual std::string name() const = 0;
+    virtual int defaultPort() const = 0; // port of the engine server, 0 for an in-process backend
+
+    // HTTP backends (the defaults throw)
+    virtual EngineRequest routeRequest(double start_long, double start_lat, double end_long, double end_lat) const;
+    virtual std::string_view routeAnswerPath() const;                    // path of the ETA in the route answer (JsonExtract)
+    virtual double parseRouteAnswer(std::string_view answer) const;      // -1 if there is no route, throws on an error answer
+    virtual EngineRequest matrixRequest(const std::vector<Point>& sources, const std::vector<Point>& targets) const;
+    // ETAs from every source to every target (row major), -1 for the pairs without a route, throws on an error answer
+    virtual std::vector<double> parseMatrixAnswer(std::string_view answer, size_t sources, size_t targets) const;
+
+    // in-process backends answer without a server (the defaults throw)
+    virtual bool inProcess() const { return false; }
+    virtual double route(double start_long, double start_lat, double end_long, double end_lat) const;
+    virtual std::vector<double> matrix(const std::vector<Point>& sources, const std::vector<Point>& targets) const;
+
+    // backend of the engine name: "osrm", "ors", "val", "mock" or "mock:<recorded answers csv>", nullptr if unknown
+    static std::unique_ptr<RoutingBackend> create(const std::string& engine);
+};
+
+// Stand-in for a routing engine to measure CoarseETA's own overhead and to load test it without an engine:
+// the ETA of a trip is its recorded answer if any (a queries csv with the engine's ETAs:
+// start_long,start_lat,end_long,end_lat,start_datetime,os_eta with a header line), else a deterministic function
+// of the trip (60 s plus the great circle distance with a 1.3 detour factor at 30 km/h)
+// Answers in process (engine = mock) or behind the loopback OSRM stand-in of the mockEngine tool
+class MockBackend : public RoutingBackend {
+public:
+    explicit MockBackend(const std::string& recorded_csv = "");
+
+    std::string name() const override { return "mock"; }
+    int defaultPort() const override { return 0; }
+    bool inProcess() const override { return true; }
+    double route(double start_long, double start_lat, double end_long, double end_lat) const override;
+    std::vector<double> matrix(const std::vector<Point>& sources, const std::vector<Point>& targets) const override;
+
+    size_t recordedTrips() const { return recorded.size(); }
+
+private:
+    using Trip = std::array<double, 4>; // start_long, start_lat, end_long, end_lat
+    struct TripHash {
+        size_t operator()(const Trip& trip) const;
+    };
+    std::unordered_map<Trip, double, TripHash> recorded;
+};
+
+#endif // ROUTING_BACKEND_H
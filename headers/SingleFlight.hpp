@@ -0,0 +1,35 @@
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+// Single-flight deduplication of identical routing engine calls in flight at the same time:
+// the first caller of a key leads and makes the call, the callers joining while it is outstanding
+// wait for it and get its ETA, so a burst of identical queries costs one engine call. Nothing is kept
+// once the call completes (see EngineCache for that)
+class SingleFlight {
+public:
+    using Callback = std::function<void(double eta)>;
+
+    // true if the caller leads the call of key (it must call complete), else done is queued
+    // and called with the leader's ETA by complete
+    bool join(const std::string& key, Callback done);
+
+    // end the call of key and hand eta to the callers that joined it (on the calling thread)
+    void complete(const std::string& key, double eta);
+
+    uint64_t coalesced() const { return coalesced_count.load(); } // calls answered by another call
+    uint64_t leaders() const { return leader_count.load(); }      // calls that went to the engine
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<Callback>> in_flight; // key -> callers waiting for it
+    std::atomic<uint64_t> coalesced_count{0}, leader_count{0};
+};
+
+#endif // SINGLE_FLIGHT_H
@@ -0,0 +1,192 @@
+#ifndef SPATIAL_ETA_TABLES_H
+#define SPATIAL_ETA_TABLES_H
+
+#include "../headers/MappedFile.hpp"
+#include "../headers/HashIndex.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Sorted ETA records of the SpatialETA table of one zone pair, read in place
+struct SpatialETATable {
+    const char* records = nullptr; // record_size bytes per record
+    long long total = 0;           // number of records
+    int record_size = 8;           // single record size
+    int eta_offset = 0;            // offset of the eta bytes in a single record
+    uint32_t quantile_intervals = 0; // 0 for a full table, else the ETAs are the knots of a quantile sketch
+
+    // optional search accelerator: the ETAs probed by the top levels of the binary search
+    // (mid = lo + (hi - lo) / 2 from lo = 0, hi = total - 1) in BFS (Eytzinger) order,
+    // node k has its children at 2k + 1 (ETA < node) and 2k + 2 (ETA > node)
+    const double* tree = nullptr;
+    long long tree_size = 0;       // 2^levels - 1 nodes or 0 without accelerator
+
+    // ETA of the record at record_idx
+    double eta(long long record_idx) const {
+        double v;
+        memcpy(&v, records + record_idx * record_size + eta_offset, sizeof(double));
+        return v;
+    }
+};
+
+// Source of the SpatialETA tables of the zone pairs (dense zone indices)
+class SpatialETAStore {
+public:
+    using Handle = std::shared_ptr<const SpatialETATable>; // keeps the table's memory mapped while held
+
+    virtual ~SpatialETAStore() = default;
+
+    // table of the zone pair, throws if there is none (thread safe)
+    virtual Handle get(uint32_t zone1, uint32_t zone2) const = 0;
+
+    // bound the memory held by the store (if it maps tables on demand)
+    virtual void setLimits(size_t /*max_tables*/, size_t /*max_bytes*/) {}
+
+    // build a search tree of up to max_levels (0 disables) for the tables of at least min_records
+    // when they are first used, the tree stops when the remaining range fits in about a page of ETAs
+    virtual void setSearchTree(int max_levels, long long min_records) = 0;
+
+    // a SpatialETAArchive if path is a file, else a SpatialETATableCache over the folder
+    static std::unique_ptr<SpatialETAStore> open(const std::string& path,
+                                                 const std::vector<std::string>& zone_ids,
+                                                 int record_size, int eta_offset);
+
+    // madvise WILLNEED the pages of the table's records if they take at most max_bytes
+    static void prefetch(const SpatialETATable& table, size_t max_bytes);
+
+    // the top levels of the binary search over table (see SpatialETATable::tree)
+    static std::vector<double> buildSearchTree(const SpatialETATable& table, int max_levels, long long min_records);
+};
+
+// Pool of memory mapped SpatialETA table files (<zone1>_<zone2>.bin in a folder) mapped on first use
+// and kept in an LRU bounded by the number of mapped tables and the total mapped bytes
+// Thread safe, a handle keeps its table mapped even after it is evicted
+class SpatialETATableCache : public SpatialETAStore {
+public:
+    SpatialETATableCache(const std::string& folder,              // SpatialETA tables folder path
+                         const std::vector<std::string>& zone_ids, // zone ids of the dense zone indices (file names)
+                         int record_size,                        // single record size
+                         int eta_offset,                         // eta offset in the single record
+                         size_t max_tables = 1024,               // max mapped tables
+                         size_t max_bytes = size_t(4) << 30);    // max mapped bytes
+
+    // table of the zone pair, throws if the file cannot be opened
+    Handle get(uint32_t zone1, uint32_t zone2) const override;
+
+    // change the bounds of the LRU (evicting tables if needed)
+    void setLimits(size_t max_tables, size_t max_bytes) override;
+
+    // applies to the tables mapped afterwards
+    void setSearchTree(int max_levels, long long min_records) override;
+
+    // hit/miss counters
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Entry {
+        MappedFile file;
+        std::vector<double> tree; // search accelerator of the table
+        SpatialETATable table;
+    };
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+    std::string folder;
+    std::vector<std::string> zone_ids;
+    int record_size;
+    int eta_offset;
+
+    // the pool is a cache behind the const get, its state is guarded by mutex
+    mutable std::mutex mutex;
+    size_t max_tables;
+    size_t max_bytes;
+    mutable size_t mapped_bytes = 0;
+    int tree_levels = 16;
+    long long tree_min_records = 4096;
+    mutable uint64_t hit_count = 0, miss_count = 0;
+    mutable std::list<std::pair<uint64_t, EntryPtr>> lru; // most recently used first
+    mutable std::unordered_map<uint64_t, std::list<std::pair<uint64_t, EntryPtr>>::iterator> tables; // zone pair -> lru node
+
+    EntryPtr map(uint32_t zone1, uint32_t zone2, int levels, long long min_records) const; // map the file of the zone pair
+    void evict() const; // drop the least recently used tables while over the bounds (mutex held)
+};
+
+// Header of the SpatialETA archive, a single file replacing the folder of <zone1>_<zone2>.bin tables,
+// followed by 8-byte aligned sections:
+//   zones:     num_zones x { uint32 length, chars } (the zone ids of the dense zone indices in the directory)
+//   directory: num_pairs x SpatialETAArchiveEntry sorted by (zone1, zone2)
+//   data:      the sorted ETAs (doubles) of every table concatenated in directory order
+// A quantile sketch archive (quantile_intervals > 0) stores per table the ETAs at the quantile_intervals + 1
+// evenly spaced fractional ranks j * (n - 1) / quantile_intervals (linearly interpolated between records), or all
+// n ETAs when n <= quantile_intervals + 1. Interpolating the rank of an ETA over these knots, exactly as over the
+// full table, gives a rank percentage within 100 / quantile_intervals percentage points of the exact one
+// (the exact and sketched CDFs agree at every knot and both are monotone in between) for an ETA that matches no
+// run of tied records. An ETA matching a run of tied knots ranks at the middle of the run in the sketch, while the
+// full tables keep ranking it at the record the binary search lands on, anywhere in the run
+// v1 archives have the same layout without the last two header fields and always store full tables
+struct SpatialETAArchiveHeader {
+    char     magic[8];          // SpatialETAArchive::MAGIC
+    uint32_t version;           // 2 (or 1)
+    uint32_t num_zones;
+    uint64_t num_pairs;
+    uint64_t zones_offset;      // byte offsets of the sections from the start of the file
+    uint64_t directory_offset;
+    uint64_t data_offset;
+    uint32_t quantile_intervals; // 0 for full tables, else the tables are quantile sketches (v2)
+    uint32_t reserved;
+};
+
+struct SpatialETAArchiveEntry {
+    uint32_t zone1, zone2;  // dense zone indices of the archive
+    uint64_t offset;        // first ETA of the table (in ETAs from data_offset)
+    uint64_t count;         // number of ETAs of the table
+};
+
+// SpatialETA tables read in place from a single memory mapped archive
+class SpatialETAArchive : public SpatialETAStore {
+public:
+    static constexpr char MAGIC[8] = {'C', 'E', 'T', 'A', 'S', 'P', 'A', 'R'};
+    static constexpr uint32_t VERSION = 2;
+
+    SpatialETAArchive(const std::string& path,                   // archive file path
+                      const std::vector<std::string>& zone_ids); // zone ids of the dense zone indices
+
+    // table of the zone pair, throws if the archive has none
+    Handle get(uint32_t zone1, uint32_t zone2) const override;
+
+    // applies to the tables not used yet
+    void setSearchTree(int max_levels, long long min_records) override;
+
+    // pack a folder of <zone1>_<zone2>.bin tables (zone ids must not contain '_') into an archive at path,
+    // quantile_intervals > 0 builds a quantile sketch archive instead of copying the full tables
+    static void build(const std::string& folder, const std::string& path, int record_size = 8, int eta_offset = 0,
+                      uint32_t quantile_intervals = 0);
+
+    // 0 for full tables or the intervals of the quantile sketch (rank error bound 100 / intervals percentage points)
+    uint32_t quantileIntervals() const { return quantile_intervals; }
+
+private:
+    std::shared_ptr<const MappedFile> file; // owner of the mapping shared with the handles
+    uint32_t quantile_intervals = 0;
+    std::vector<SpatialETATable> tables;    // view of each directory entry
+    FlatHashIndex pairs;                    // runtime zone pair -> index in tables
+
+    // the view served for each table, published on first use (with its search tree if it gets one)
+    std::unique_ptr<std::atomic<const SpatialETATable*>[]> served;
+    mutable std::mutex mutex;                       // guards the lazily built trees and the tree settings
+    mutable std::deque<SpatialETATable> accelerated; // views with a search tree (stable addresses)
+    mutable std::deque<std::vector<double>> trees;
+    int tree_levels = 16;
+    long long tree_min_records = 4096;
+
+    const SpatialETATable* serve(size_t idx) const; // publish the view of table idx
+};
+
+#endif // SPATIAL_ETA_TABLES_H
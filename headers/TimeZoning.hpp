@@ -0,0 +1,91 @@
+#ifndef TIME_ZONING_H
+#define TIME_ZONING_H
+
+#include "../headers/HashIndex.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <iostream>
+
+// Calendar fields of a local trip start time
+struct LocalTime {
+    int year, month, day;        // month 1-12, day 1-31
+    int hour, minute, second;
+    int weekday;                 // 0-6 (Mon=0 ... Sunday=6) as the dataset was prepared in python
+};
+
+struct TimeZone {
+    int season;           // 1 (Mar-May), 2 (Jun-Aug), 3 (Sep-Nov), 4 (Dec-Feb) for seasons
+    int day_of_week;      // 0-6 (Mon=0, Tues=1, Wed=2, Thu=3, Fri=4, Sat=5, Sunday=6)
+    int daytype;          // 0 weekday or 1 weekend
+    int adjusted_hour;    // 0-23 with rounding to the nearest hour
+    int start_hour;       // start of hour range for time periods
+    int end_hour;         // end of hour range for time periods
+
+    // For debugging
+    void print() const {
+        std::cout << "Season: " << season << ", "
+                  << "Day of week: " << day_of_week << ", "
+                  << "Daytype: " << (daytype ? "weekend" : "weekday") << ", "
+                  << "Adjusted hour: " << adjusted_hour << ", "
+                  << "Hour range: [" << start_hour << " - " << end_hour << "]\n";
+    }
+};
+
+// Temporal zoning of the trip start times into the time part of the hash index keys (HashKey::timeBits)
+// The seasons of the months and the hour ranges are compiled into a table of the time bits of every
+// (month, weekday, hour, minute past the half hour), so zoning a time is a fixed-format parse and a lookup
+// Unix epoch times are first moved to the local time of the configured time zone with its table of UTC offset
+// transitions (read from the tz database, extended past its last transition with its POSIX rule)
+class TimeZoning {
+public:
+    explicit TimeZoning(TimeZoningType type); // seasons Mar-May, Jun-Aug, Sep-Nov, Dec-Feb, the 6 default hour ranges, UTC
+
+    // season (0-7) of every month from January, e.g. "4,4,1,1,1,2,2,2,3,3,3,4" (the default)
+    // throws std::invalid_argument if the list is malformed
+    void setSeasons(const std::string& month_seasons);
+    // hour ranges of the adjusted hours covering 0-23 once, e.g. "0-6,7-10,11-13,14-16,17-19,20-23" (the default)
+    // throws std::invalid_argument if the list is malformed or does not cover every hour once
+    void setHourRanges(const std::string& hour_ranges);
+    // local time zone of the epoch times: "UTC" (the default) or a tz database name (e.g. "America/New_York") or
+    // path of a TZif file, throws std::invalid_argument if it cannot be read
+    void setLocalTimeZone(const std::string& name);
+
+    // time bits of a "%Y-%m-%d %H:%M:%S" local time (' ' or 'T' between date and time, anything after the seconds
+    // is ignored), throws std::invalid_argument if it is malformed
+    uint64_t timeBits(std::string_view timestamp) const;
+    // time bits of a Unix epoch time in seconds in the local time zone
+    uint64_t timeBits(int64_t epoch_seconds) const;
+    uint64_t timeBits(const LocalTime& t) const {
+        return table[(((t.month - 1) * 7 + t.weekday) * 24 + t.hour) * 2 + (t.minute > 30)];
+    }
+
+    // the zoning of a local time (the fields the time bits are packed from)
+    TimeZone timeZone(const LocalTime& t) const;
+
+    // parse a timestamp as timeBits does without allocating, false if it is malformed
+    static bool parseTimestamp(std::string_view timestamp, LocalTime& t);
+    // local time of an epoch time in the local time zone
+    LocalTime localTime(int64_t epoch_seconds) const;
+
+    // days since 1970-01-01 of a proleptic Gregorian date and back
+    static int64_t daysFromCivil(int year, int month, int day);
+    static void civilFromDays(int64_t days, int& year, int& month, int& day);
+
+private:
+    TimeZoningType type;
+    int month_season[12];
+    std::vector<std::pair<int, int>> ranges;  // hour ranges in hour order
+    std::vector<uint16_t> table;              // time bits per ((month - 1) * 7 + weekday) * 48 + hour * 2 + half
+
+    std::vector<int64_t> transitions;         // UTC times where the offset changes, ascending
+    std::vector<int32_t> offsets;             // UTC offset in seconds from each transition on
+    int32_t initial_offset = 0;               // UTC offset before the first transition
+
+    void compile();                           // fill table from the seasons and the hour ranges
+    int32_t utcOffset(int64_t epoch_seconds) const;
+};
+
+#endif // TIME_ZONING_H
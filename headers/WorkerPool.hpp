@@ -0,0 +1,62 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+
+// Fixed pool of worker threads running parallel loops with work stealing
+// parallelFor splits the index range into chunks dealt round robin to one deque per worker, a worker takes
+// chunks from the front of its own deque and steals from the back of the others once it runs dry, so uneven
+// item costs (cold tables, slow engine answers) do not leave threads idle while others still have a backlog
+// concurrent parallelFor calls share the deques, each waits only for the chunks of its own loop
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads = 0); // 0 uses all the hardware threads
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const { return threads.size(); }
+
+    // run fn(i) for every i in [0, n) on the workers and wait for all of them (must not be called from fn),
+    // the first exception thrown by fn is rethrown once the loop is done
+    void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+private:
+    // state of one parallelFor call, on its caller's stack
+    struct Loop {
+        const std::function<void(size_t)>* fn;
+        std::atomic<size_t> pending;      // chunks not finished yet
+        std::exception_ptr error;         // guarded by mutex
+    };
+    struct Chunk {
+        Loop* loop;
+        size_t begin, end;                // [begin, end) index range
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker
+    std::atomic<size_t> next_queue{0};    // first queue of the next loop, spreads concurrent loops over the workers
+
+    std::mutex mutex;                     // guards stopping, the loop errors and the increments of queued
+    std::condition_variable wake, done;
+    std::atomic<size_t> queued{0};        // chunks in the queues (counted before they are pushed)
+    bool stopping = false;
+
+    void work(size_t id);
+    bool take(size_t id, Chunk& chunk); // own chunk or a stolen one
+};
+
+#endif // WORKER_POOL_H
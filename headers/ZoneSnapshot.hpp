@@ -0,0 +1,121 @@
+#ifndef ZONE_SNAPSHOT_H
+#define ZONE_SNAPSHOT_H
+
+#include "../headers/ReadZones.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+// Bytes of a snapshot section: plain values and vectors of them (a uint64 count then the items) back to back
+class SnapshotWriter {
+public:
+    template <class T> void value(const T& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied bytewise");
+        bytes.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+    template <class T> void array(const std::vector<T>& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied bytewise");
+        value<uint64_t>(v.size());
+        bytes.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+    }
+    void string(const std::string& s) {
+        value<uint32_t>(s.size());
+        bytes.append(s);
+    }
+    void edges(const EdgeArrays& e) {
+        for (const auto* column : {&e.xi, &e.yi, &e.yj, &e.dx, &e.dy}) array(*column);
+    }
+
+    std::string bytes;
+};
+
+// Reader of the sections written by SnapshotWriter, throws if they run past the end of the data
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size) : pos(data), end(data + size) {}
+
+    template <class T> T value() {
+        T v;
+        memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+    template <class T> void array(std::vector<T>& v) {
+        uint64_t count = value<uint64_t>();
+        if (count > static_cast<uint64_t>(end - pos) / sizeof(T)) throw std::runtime_error("Truncated zone snapshot");
+        v.resize(count);
+        if (count) memcpy(v.data(), take(count * sizeof(T)), count * sizeof(T));
+    }
+    std::string string() {
+        uint32_t length = value<uint32_t>();
+        return std::string(take(length), length);
+    }
+    void edges(EdgeArrays& e) {
+        for (auto* column : {&e.xi, &e.yi, &e.yj, &e.dx, &e.dy}) array(*column);
+        size_t n = e.xi.size();
+        if (e.yi.size() != n || e.yj.size() != n || e.dx.size() != n || e.dy.size() != n)
+            throw std::runtime_error("Corrupt edges in zone snapshot");
+    }
+
+private:
+    const char* pos;
+    const char* end;
+
+    const char* take(size_t n) {
+        if (n > static_cast<size_t>(end - pos)) throw std::runtime_error("Truncated zone snapshot");
+        const char* at = pos;
+        pos += n;
+        return at;
+    }
+};
+
+// Header of the zone snapshot file, followed by the ZoneStore then the spatial index (SnapshotWriter sections)
+struct ZoneSnapshotHeader {
+    char     magic[8];          // ZoneSnapshot::MAGIC
+    uint32_t version;           // ZoneSnapshot::VERSION
+    uint32_t index_type;        // 0 grid, 1 quadtree
+    uint64_t csv_size;          // size and modification time (ns) of the zones csv the snapshot was made from
+    int64_t  csv_mtime_ns;
+    uint64_t leaf_size;         // SpatialIndex::create parameters of the index
+    int32_t  cells_per_degree;
+    uint32_t reserved;
+};
+
+// Binary snapshot of the zones parsed from a csv and of the spatial index built on them, loaded in a few ms on
+// restart instead of parsing the WKT and classifying the grid again. A snapshot is tied to the csv it was made from:
+// once the csv changes (its size or modification time), the snapshot is ignored and rewritten
+class ZoneSnapshot {
+public:
+    static constexpr char MAGIC[8] = {'C', 'E', 'T', 'A', 'Z', 'O', 'N', 'E'};
+    static constexpr uint32_t VERSION = 1;
+
+    std::shared_ptr<const ZoneStore> zones;
+    std::unique_ptr<SpatialIndex> index;    // loaded or built with the zones, for the caller to take over
+    std::string index_type = "grid"; // SpatialIndex::create parameters of the index
+    size_t leaf_size = 8;
+    int cells_per_degree = 0;
+    uint64_t csv_size = 0;          // state of the csv the zones were parsed from
+    int64_t csv_mtime_ns = 0;
+
+    // the snapshot next to the csv (<csv>.snapshot)
+    static std::string pathOf(const std::string& csv_path) { return csv_path + ".snapshot"; }
+
+    // the snapshot of the csv if it is up to date, else the zones parsed from the csv with a grid index
+    // (auto resolution), saved as its new snapshot (a warning if it cannot be written)
+    static ZoneSnapshot open(const std::string& csv_path);
+
+    // load the snapshot at path, false if it is missing, of another version or made from another state of the csv
+    bool load(const std::string& path, const std::string& csv_path);
+
+    // whether the index was created with these SpatialIndex::create parameters (the ones its type uses)
+    bool matches(const std::string& type, size_t leaf_size, int cells_per_degree) const;
+
+    // write the zones and index (created with the parameters above) to path through a temporary file renamed
+    // over it, throws if it cannot be written
+    void save(const std::string& path, const SpatialIndex& index) const;
+};
+
+#endif // ZONE_SNAPSHOT_H
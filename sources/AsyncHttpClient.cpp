@@ -0,0 +1,350 @@
+#include "../headers/AsyncHttpClient.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+AsyncHttpClient::AsyncHttpClient(const std::string& host, int port, size_t max_connections, size_t pipeline_depth)
+    : host(host), port(port),
+      max_connections(max_connections ? max_connections : 1),
+      pipeline_depth(pipeline_depth ? pipeline_depth : 1) {}
+
+AsyncHttpClient::~AsyncHttpClient() {
+    if (!loop.joinable()) return; // never started
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+    loop.join();
+    close(epoll_fd);
+    close(wake_fd);
+}
+
+void AsyncHttpClient::setTimeouts(int connect_timeout, int read_timeout) {
+    connect_timeout_ms = std::max(connect_timeout, 0);
+    read_timeout_ms = std::max(read_timeout, 0);
+}
+
+HttpDeadline AsyncHttpClient::after(int timeout_ms) const {
+    return timeout_ms > 0 ? Clock::now() + std::chrono::milliseconds(timeout_ms) : HttpDeadline::max();
+}
+
+void AsyncHttpClient::start() {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        throw std::runtime_error("Cannot resolve host: " + host);
+    addr.assign(reinterpret_cast<char*>(res->ai_addr), reinterpret_cast<char*>(res->ai_addr) + res->ai_addrlen);
+    freeaddrinfo(res);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) throw std::runtime_error("Cannot create the event loop");
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    loop = std::thread(&AsyncHttpClient::run, this);
+}
+
+void AsyncHttpClient::request(const std::string& method, const std::string& path, const std::string& body, Callback done,
+                              HttpDeadline deadline) {
+    std::call_once(started, &AsyncHttpClient::start, this);
+    Pending pending{HttpClient::buildRequest(host, method, path, body), std::move(done), deadline, method == "GET"};
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake = submitted.empty(); // the loop drains the whole queue per wake up
+        submitted.push_back(std::move(pending));
+    }
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+std::future<std::string> AsyncHttpClient::request(const std::string& method, const std::string& path, const std::string& body) {
+    auto promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+    request(method, path, body, [promise](std::string response, std::exception_ptr error) {
+        if (error) promise->set_exception(error);
+        else promise->set_value(std::move(response));
+    });
+    return result;
+}
+
+void AsyncHttpClient::run() {
+    epoll_event events[64];
+    for (;;) {
+        int n = epoll_wait(epoll_fd, events, 64, nextTimeout());
+        if (n < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd) {
+                uint64_t count;
+                ssize_t ignored = read(wake_fd, &count, sizeof(count));
+                (void)ignored;
+                continue;
+            }
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue; // dropped earlier in this batch
+            Connection& c = *it->second;
+            uint32_t e = events[i].events;
+
+            if (c.connecting && (e & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t len = sizeof(err);
+                getsockopt(c.sock, SOL_SOCKET, SO_ERROR, &err, &len);
+                if (err != 0) {
+                    drop(c, std::make_exception_ptr(std::runtime_error("Connection failed to " + host)));
+                    continue;
+                }
+                c.connecting = false;
+                c.read_by = after(read_timeout_ms); // the requests queued while connecting are sent now
+            }
+            if (e & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                receive(c);
+                if (!connections.count(fd)) continue; // dropped while receiving
+            }
+            if (!c.connecting && (e & EPOLLOUT)) flush(c);
+        }
+
+        // new requests, resends and room freed in the pipelines are dispatched once the whole batch of events
+        // is handled (so a socket number closed and reused within the batch cannot get a stale event)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!submitted.empty()) {
+                waiting.push_back(std::move(submitted.front()));
+                submitted.pop_front();
+            }
+            if (stopping) break;
+        }
+        expire();
+        dispatch();
+    }
+
+    // fail everything still pending
+    auto stopped = std::make_exception_ptr(std::runtime_error("HTTP client stopped"));
+    for (auto& entry : connections) {
+        for (auto& pending : entry.second->in_flight) pending.done({}, stopped);
+        close(entry.second->sock);
+    }
+    connections.clear();
+    for (auto& pending : waiting) pending.done({}, stopped);
+    waiting.clear();
+}
+
+void AsyncHttpClient::dispatch() {
+    while (!waiting.empty()) {
+        // the least loaded connection with room in its pipeline
+        Connection* best = nullptr;
+        for (auto& entry : connections) {
+            Connection* c = entry.second.get();
+            if (c->in_flight.size() < (persistent ? pipeline_depth : 1) && (!best || c->in_flight.size() < best->in_flight.size()))
+                best = c;
+        }
+        // open another connection rather than pipelining behind a busy one
+        if ((!best || !best->in_flight.empty()) && connections.size() < max_connections) {
+            Connection* fresh = openConnection();
+            if (fresh) best = fresh;
+            else if (!best) {
+                // the server cannot be reached, fail the requests instead of queueing them forever
+                auto error = std::make_exception_ptr(std::runtime_error("Connection failed to " + host));
+                for (auto& pending : waiting) pending.done({}, error);
+                waiting.clear();
+                return;
+            }
+        }
+        if (!best) return; // every pipeline is full, resume when responses come back
+
+        if (!best->in_flight.empty()) pipelined++;
+        else best->read_by = after(read_timeout_ms); // the server has been idle on it until now
+        best->out.append(waiting.front().bytes);
+        best->in_flight.push_back(std::move(waiting.front()));
+        waiting.pop_front();
+        if (!best->connecting) flush(*best);
+    }
+}
+
+AsyncHttpClient::Connection* AsyncHttpClient::openConnection() {
+    const sockaddr* sa = reinterpret_cast<const sockaddr*>(addr.data());
+    int sock = socket(sa->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) return nullptr;
+    if (connect(sock, sa, addr.size()) < 0 && errno != EINPROGRESS) {
+        close(sock);
+        return nullptr;
+    }
+    int one = 1; // pipelined requests are written as soon as they are queued
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    auto c = std::make_unique<Connection>();
+    c->sock = sock;
+    c->connect_by = after(connect_timeout_ms);
+    c->read_by = HttpDeadline::max();
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    ev.data.fd = sock;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &ev);
+    opened++;
+    Connection* raw = c.get();
+    connections[sock] = std::move(c);
+    return raw;
+}
+
+void AsyncHttpClient::flush(Connection& c) {
+    while (c.out_sent < c.out.size()) {
+        ssize_t n = send(c.sock, c.out.data() + c.out_sent, c.out.size() - c.out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            drop(c, std::make_exception_ptr(std::runtime_error("Send failed")));
+            return;
+        }
+        c.out_sent += n;
+    }
+    if (c.out_sent == c.out.size()) {
+        c.out.clear();
+        c.out_sent = 0;
+    }
+    updateEvents(c);
+}
+
+void AsyncHttpClient::updateEvents(Connection& c) {
+    bool want_write = c.connecting || !c.out.empty();
+    if (want_write == c.want_write) return;
+    c.want_write = want_write;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | (want_write ? uint32_t(EPOLLOUT) : 0u);
+    ev.data.fd = c.sock;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.sock, &ev);
+}
+
+void AsyncHttpClient::receive(Connection& c) {
+    char buf[16384];
+    bool eof = false;
+    for (;;) {
+        HttpClient::quickAck(c.sock);
+        ssize_t n = recv(c.sock, buf, sizeof(buf), 0);
+        if (n > 0) {
+            c.in.append(buf, n);
+            c.read_by = after(read_timeout_ms);
+            continue;
+        }
+        if (n == 0) { eof = true; break; }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        eof = true; // reset, handled as a close
+        break;
+    }
+
+    // complete every response parsed, they come back in request order
+    HttpResponse response;
+    bool keep_alive = true;
+    while (!c.in_flight.empty()) {
+        bool complete;
+        try {
+            complete = HttpResponseParser::parse(c.in, response, eof);
+        } catch (...) {
+            drop(c, std::current_exception());
+            return;
+        }
+        if (!complete) break;
+        Pending done = std::move(c.in_flight.front());
+        c.in_flight.pop_front();
+        c.answered = true;
+        done.done(std::move(response.body), nullptr);
+        if (!response.keep_alive) {
+            persistent = false; // the server closes its connections, stop pipelining behind them
+            keep_alive = false;
+            break;
+        }
+    }
+
+    if (eof || !keep_alive) {
+        drop(c, std::make_exception_ptr(std::runtime_error(
+            c.in.empty() ? "Connection closed by " + host : "Truncated HTTP response")));
+        return;
+    }
+}
+
+void AsyncHttpClient::drop(Connection& c, std::exception_ptr error) {
+    int sock = c.sock;
+    std::deque<Pending> in_flight = std::move(c.in_flight);
+    bool partial = !c.in.empty(); // the first request got part of its response
+    bool answered = c.answered;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+    close(sock);
+    connections.erase(sock); // c is gone from here
+
+    // the requests without any response bytes were not processed by the server as far as we can tell:
+    // resend them if the connection had been answering (closed keep-alive or a server closing after n requests),
+    // each resend follows an answered request so this ends, a connection failing before any answer fails its requests
+    for (size_t i = 0; i < in_flight.size(); i++) {
+        Pending& pending = in_flight[i];
+        if (answered && !(i == 0 && partial)) {
+            waiting.push_back(std::move(pending));
+        } else {
+            pending.done({}, error);
+        }
+    }
+}
+
+int AsyncHttpClient::nextTimeout() const {
+    HttpDeadline next = HttpDeadline::max();
+    if (!waiting.empty()) next = waiting.front().deadline; // in submission order, the earliest in practice
+    for (const auto& entry : connections) {
+        const Connection& c = *entry.second;
+        if (c.connecting) next = std::min(next, c.connect_by);
+        else if (!c.in_flight.empty()) next = std::min(next, c.read_by);
+        for (const auto& pending : c.in_flight) next = std::min(next, pending.deadline);
+    }
+    return HttpClient::pollTimeout(next, 0);
+}
+
+void AsyncHttpClient::expire() {
+    auto now = Clock::now();
+    while (!waiting.empty() && waiting.front().deadline <= now) {
+        Pending pending = std::move(waiting.front());
+        waiting.pop_front();
+        pending.done({}, std::make_exception_ptr(HttpTimeout("Deadline exceeded waiting for a connection to " + host)));
+    }
+
+    std::vector<int> timed_out;
+    for (const auto& entry : connections) {
+        const Connection& c = *entry.second;
+        bool expired = c.connecting ? c.connect_by <= now : (!c.in_flight.empty() && c.read_by <= now);
+        for (size_t i = 0; i < c.in_flight.size() && !expired; i++) expired = c.in_flight[i].deadline <= now;
+        if (expired) timed_out.push_back(entry.first);
+    }
+    for (int fd : timed_out) {
+        Connection& c = *connections[fd];
+        // a stalled server fails all the requests on the connection, else the expired ones fail and the others,
+        // which the server may have processed already, are resent in their order if they are GETs (the pipeline
+        // cannot skip a response without closing the connection) and fail with the timeout if not
+        bool stalled = c.connecting ? c.connect_by <= now : c.read_by <= now;
+        const char* what = c.connecting ? "Connect timed out to " : stalled ? "Read timed out from " : "Deadline exceeded from ";
+        auto error = std::make_exception_ptr(HttpTimeout(what + host));
+        std::deque<Pending> in_flight = std::move(c.in_flight);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections.erase(fd);
+        for (auto it = in_flight.rbegin(); it != in_flight.rend(); ++it) {
+            if (stalled || it->deadline <= now || !it->idempotent) it->done({}, error);
+            else waiting.push_front(std::move(*it));
+        }
+    }
+}
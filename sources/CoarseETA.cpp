@@ -1,6 +1,5 @@
 #include "../headers/CoarseETA.hpp"
 
-
 CoarseETA::CoarseETA(const std::string& spatialETA_path,
                      const std::string& hashTable_file,
                      const std::string& zones_path_csv,
@@ -16,113 +15,197 @@ CoarseETA::CoarseETA(const std::string& spatialETA_path,
       zones_path_csv(zones_path_csv),
       routingengine_server(routingengine_server),
       engine(engine),
-      zones(WKTParser::parseCSV(zones_path_csv)),
-      spatial_index(zones),
-      time_zoning_type(time_zoning_type)
+      time_zoning_type(time_zoning_type),
+      time_zoning(time_zoning_type),
+      zone_snapshot(ZoneSnapshot::open(zones_path_csv)),
+      zones(zone_snapshot.zones),
+      spatial_index(std::move(zone_snapshot.index)),
+      hash_index(time_zoning_type, zones->ids()),
+      spatial_tables(SpatialETAStore::open(spatialETA_path, zones->ids(), record_size, eta_offset))
 {
     // Initialize aggregate_ranks map
     aggregate_ranks["min_max"] = {0, 100};
     aggregate_ranks["min_med_max"] = {0, 50, 100};
     aggregate_ranks["percentiles"] = {0, 25, 50, 75, 100};
     setup_hash_table();
+    backend = RoutingBackend::create(engine);
+    if (backend && backend->defaultPort())
+        engine_replicas = std::make_unique<EngineReplicas>(routingengine_server, backend->defaultPort());
+    setEnginePoolSize(4);
+    setEngineAsync(8, 16);
+    setEngineTimeouts(2000, 30000);
+    setEngineCoalescing(true);
+    setAsyncPipeline(2, 2, 1024);
+}
+
+void CoarseETA::setWorkerThreads(size_t threads) {
+    std::lock_guard<std::mutex> lock(workers_mutex);
+    worker_threads = threads;
+    workers.reset(); // the next parallel call starts the new pool, the running ones keep the old one
+}
+
+std::shared_ptr<WorkerPool> CoarseETA::workerPool() const {
+    std::lock_guard<std::mutex> lock(workers_mutex);
+    if (!workers) workers = std::make_shared<WorkerPool>(worker_threads);
+    return workers;
+}
+
+void CoarseETA::setEnginePoolSize(size_t pool_size) {
+    // keep-alive connections to each routing engine server, reused across queries
+    if (engine_replicas) engine_replicas->setPoolSize(pool_size);
+}
+
+void CoarseETA::setEngineTimeouts(int connect_timeout_ms, int read_timeout_ms) {
+    if (engine_replicas) engine_replicas->setTimeouts(connect_timeout_ms, read_timeout_ms);
+}
+
+void CoarseETA::setEngineDeadline(double budget_ms, const std::string& fallback) {
+    if (fallback != "error" && fallback != "coarse")
+        throw std::invalid_argument("Unknown deadline fallback: " + fallback +
+                                    "\nShould be either \"error\" or \"coarse\"\n");
+    engine_deadline_ms = budget_ms > 0 ? budget_ms : 0;
+    deadline_fallback_coarse = fallback == "coarse";
+}
+
+void CoarseETA::setEngineHedging(double percentile) {
+    if (engine_replicas) engine_replicas->setHedging(percentile);
+}
+
+uint64_t CoarseETA::engineHedgedCalls() const {
+    return engine_replicas ? engine_replicas->hedgedCalls() : 0;
+}
+
+HttpDeadline CoarseETA::engineDeadline(std::chrono::steady_clock::time_point start) const {
+    if (engine_deadline_ms <= 0) return HttpDeadline::max();
+    return start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                       std::chrono::duration<double, std::milli>(engine_deadline_ms));
+}
+
+double CoarseETA::deadlineFallback(const ZonedQuery& zoned) const {
+    if (!deadline_fallback_coarse) throw std::runtime_error("Routing engine deadline exceeded");
+    // the zone pair's median ground truth ETA, interpolated between the aggregates around rank 50 (e.g. for min_max)
+    return aggregateETA(zoned.aggregates, 50);
+}
+
+void CoarseETA::setEngineCache(size_t max_entries, int precision, double ttl_seconds) {
+    if (max_entries == 0) engine_cache.reset();
+    else engine_cache = std::make_unique<EngineCache>(backend ? backend->name() : engine, max_entries, precision, ttl_seconds);
+}
+
+uint64_t CoarseETA::engineCacheHits() const {
+    return engine_cache ? engine_cache->hits() : 0;
+}
+
+uint64_t CoarseETA::engineCacheMisses() const {
+    return engine_cache ? engine_cache->misses() : 0;
+}
+
+void CoarseETA::setEngineCoalescing(bool enabled) {
+    if (!enabled) engine_flights.reset();
+    else if (!engine_flights) engine_flights = std::make_unique<SingleFlight>();
+}
+
+uint64_t CoarseETA::engineCoalescedCalls() const {
+    return engine_flights ? engine_flights->coalesced() : 0;
+}
+
+void CoarseETA::setEngineAsync(size_t max_connections, size_t pipeline_depth) {
+    // non-blocking connections of the async engine calls, the event loops start with the first call
+    if (engine_replicas) engine_replicas->setAsync(max_connections, pipeline_depth);
 }
 
 void CoarseETA::setup_hash_table() {
-    std::ifstream f(hashTable_file, std::ios::binary);
-    uint64_t num_entries; // How many entries to load
-    f.read(reinterpret_cast<char*>(&num_entries), 8);
-    std::cout << "Loading Hash table index with " << num_entries << " entries...\n";
-    
-    for (uint64_t i = 0; i < num_entries; ++i) {
-        uint32_t key_len; // get key
-        f.read(reinterpret_cast<char*>(&key_len), 4);
-        std::string key(key_len, '\0');
-        f.read(&key[0], key_len);
-        
-        double buffer[10]; // get values 2 (min_max) + 3 (min_med_max) + 5 (percentiles)
-        f.read(reinterpret_cast<char*>(buffer), 80);
-        
-        // save the read values
-        AggregateValues values; 
-        values.min_max = {buffer[0], buffer[1]};
-        values.min_med_max = {buffer[2], buffer[3], buffer[4]};
-        values.percentiles = {buffer[5], buffer[6], buffer[7], buffer[8], buffer[9]};
-        
-        hash_table[key] = values;
-    }    
-    std::cout << "Loaded the" << hash_table.size() << " entries!\n";
+    // v2 files are memory mapped and queried in place, v1 files are parsed into memory
+    hash_index.load(hashTable_file);
+}
+
+void CoarseETA::setSpatialTableCache(size_t max_tables, size_t max_mb) {
+    spatial_tables->setLimits(max_tables, max_mb << 20);
+}
+
+void CoarseETA::setSpatialSearchTree(int max_levels, long long min_records) {
+    spatial_tables->setSearchTree(max_levels, min_records);
+}
+
+void CoarseETA::setSpatialIndex(const std::string& type, size_t leaf_size, int grid_cells_per_degree) {
+    if (zone_snapshot.matches(type, leaf_size, grid_cells_per_degree)) return; // built at startup or loaded from the snapshot
+    spatial_index = SpatialIndex::create(type, zones, leaf_size, grid_cells_per_degree);
+    // the next start loads this index from the snapshot
+    zone_snapshot.index_type = type;
+    zone_snapshot.leaf_size = leaf_size;
+    zone_snapshot.cells_per_degree = grid_cells_per_degree;
+    try {
+        zone_snapshot.save(ZoneSnapshot::pathOf(zones_path_csv), *spatial_index);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << "\n";
+    }
+}
+
+void CoarseETA::setPointInPolygonKernel(const std::string& kernel) {
+    PointInPolygon::select(kernel);
+}
+
+void CoarseETA::setTimeZoning(const std::string& seasons, const std::string& hour_ranges, const std::string& local_time_zone) {
+    time_zoning.setSeasons(seasons);
+    time_zoning.setHourRanges(hour_ranges);
+    time_zoning.setLocalTimeZone(local_time_zone);
 }
 
 // set the type of agrgegate we want to use for this run of coarseETA
 void CoarseETA::setAggregateTypeField(const std::string& type) {
-    if      (type == "percentiles") field = &AggregateValues::percentiles;
-    else if (type == "min_med_max") field = &AggregateValues::min_med_max;
-    else if (type == "min_max")     field = &AggregateValues::min_max;
+    if      (type == "percentiles") field = PERCENTILES;
+    else if (type == "min_med_max") field = MIN_MED_MAX;
+    else if (type == "min_max")     field = MIN_MAX;
     else throw std::invalid_argument("Unknown aggregate type: " + type +
                                      "\nShould be either \"percentiles\" or \"min_med_max\" or \"min_max\"\n" );
+    if (!hash_index.hasField(field))
+        throw std::invalid_argument("Aggregate type " + type + " is not stored in the compacted hash index: " + hashTable_file);
 
     aggregate_type = type;
+    ranks = &aggregate_ranks.at(type);
+}
+
+// set how the hash index stores the aggregates
+void CoarseETA::setAggregateStorage(const std::string& storage, const std::string& precision) {
+    AggregatePrecision p = HashIndex::parseAggregatePrecision(precision);
+    if (storage != "full" && storage != "compact")
+        throw std::invalid_argument("Unknown aggregate storage: " + storage +
+                                    "\nShould be either \"full\" or \"compact\"\n");
+    if (hash_index.isMapped()) { // the layout of a mapped file is fixed when converting it
+        if (storage != "full" || p != F64)
+            std::cerr << "Warning: the aggregate storage of the mapped hash index is set by convertHashIndex, ignoring "
+                      << storage << "/" << precision << "\n";
+        return;
+    }
+
+    if (storage == "compact") {
+        if (field == ALL_FIELDS) throw std::invalid_argument("Set the aggregate type before compacting the hash index");
+        hash_index.compact(field, p);
+    } else if (p != F64) {
+        hash_index.compact(ALL_FIELDS, p);
+    }
 }
 
 // Process the ETA Request
-double CoarseETA::ETARequest(ETAQuery query, Timing& timing) {
+double CoarseETA::ETARequest(ETAQuery query, Timing& timing) const {
+    return ETARequest(query, timing, nullptr);
+}
+
+double CoarseETA::ETARequest(const ETAQuery& query, Timing& timing, const uint32_t* zones) const {
     try{
         auto total_time_start = std::chrono::high_resolution_clock::now(); // start the timer for the total time
+        HttpDeadline deadline = engineDeadline(std::chrono::steady_clock::now()); // budget of the query for its engine call
         // STEP 1: Zoning and Aggregates
-        // Spatial Zoning
-        std::string start_zone = spatial_index.findZoneContainingPoint(query.start_long, query.start_lat); // find the spatial zone id corresponding to the starting point
-        std::string end_zone = spatial_index.findZoneContainingPoint(query.end_long, query.end_lat); // find the spatial zone id corresponding to the ending point
-        // Temporal Zoning
-        TimeZone timeZone = timeZoning(query.start_datetime); // expand the timestamp into season, day of week, daytype, hour of day rounded to the nearest hour and hour range periods
-
-        //Perpare the key for the hash table index to get the ground truth aggregates using the spatial and temporal zones based on the requested temporal zoning type
-        std::string key = "";
-        switch(time_zoning_type) {
-            case TimeZoningType::DOW_HOD:
-                key += start_zone + "," + end_zone + "," + std::to_string(timeZone.season) + "," + std::to_string(timeZone.day_of_week) + "," + std::to_string(timeZone.adjusted_hour);
-                break;
-            case TimeZoningType::DAYTYPE_HOD:
-                key += start_zone + "," + end_zone + "," + std::to_string(timeZone.season) + "," + timeZone.daytype + "," + std::to_string(timeZone.adjusted_hour);
-                break;
-            case TimeZoningType::DOW_RANGE:
-                key += start_zone + "," + end_zone + "," + std::to_string(timeZone.season) + "," + std::to_string(timeZone.day_of_week) + "," + std::to_string(timeZone.start_hour) + "," + std::to_string(timeZone.end_hour);
-                break;
-            case TimeZoningType::DAYTYPE_RANGE:
-                key += start_zone + "," + end_zone + "," + std::to_string(timeZone.season) + "," + timeZone.daytype + "," + std::to_string(timeZone.start_hour) + "," + std::to_string(timeZone.end_hour);
-                break;
-        }
-        // Get the ground truth aggregate values and percentiles
-        const std::vector<double>& aggeregate_list_x = aggregate_ranks.at(aggregate_type); // percentiles/ranks
-        const std::vector<double>& aggeregate_list_y = hash_table.at(key).*field; // ground truth values from the hash table
+        ZonedQuery zoned;
+        zoneQuery(query, zoned, zones);
 
         // STEP 2: Ranking Percentile
         auto engine_time_start = std::chrono::high_resolution_clock::now(); // start the timer for the routing engine time
-        double os_eta = OpenSourceRoutingEngine(query.start_long, query.start_lat, query.end_long, query.end_lat); // query the routing engine to get os_eta 
+        double os_eta = OpenSourceRoutingEngine(query.start_long, query.start_lat, query.end_long, query.end_lat, deadline); // query the routing engine to get os_eta 
         auto engine_time_end = std::chrono::high_resolution_clock::now(); // end the timer for the routing engine time time
 
-        SearchResult search_result = binarySearchETA(start_zone, end_zone, os_eta); // search the spatial ETA table corresponding to the start and end zones for os_eta rank
-
-        // interpolate the rank if an exact match was not found
-        double rank = search_result.record_eta1; 
-        if (search_result.record_eta2 != -1) {
-            rank = rank + (os_eta - search_result.eta1) / (search_result.eta2 - search_result.eta1);
-        }
-        // calculate the rank in percentage where rank here is 0-indexed
-        double rank_percent = 0;
-        if (search_result.total_records > 1)
-            rank_percent = ((rank) / ((double)search_result.total_records-1)) * 100;
-
-
-        // STEP 3: Output ETA
-        // search the ground truth aggregate list for the rank percentage
-        StatResult stat_result = FindStat(aggeregate_list_x, aggeregate_list_y, rank_percent); 
-
-        // calculate the output eta as the value corresponding to the rank percentage
-        // if exact match is not found interpolate the eta
-        double final_eta = stat_result.eta1;
-        if (stat_result.rank2 != -1) {
-            final_eta = stat_result.eta1 + (stat_result.eta2 - stat_result.eta1) * ((rank_percent - stat_result.rank1) / (stat_result.rank2 - stat_result.rank1));
-        }
+        // STEP 2 (rank of os_eta) and STEP 3: Output ETA (or the deadline fallback if the engine ran out of time)
+        double final_eta = (os_eta == ENGINE_TIMED_OUT) ? deadlineFallback(zoned) : outputETA(zoned, os_eta);
         auto total_time_end = std::chrono::high_resolution_clock::now(); // end the timer for the total time
 
         // calculate routing engine time
@@ -140,240 +223,526 @@ double CoarseETA::ETARequest(ETAQuery query, Timing& timing) {
     }
 }
 
+// Process the ETA Request for a known routing engine ETA
+double CoarseETA::ETAFromEngineETA(const ETAQuery& query, double os_eta) const {
+    try {
+        ZonedQuery zoned;
+        zoneQuery(query, zoned);
+        return outputETA(zoned, os_eta);
+    } catch (const std::exception& e) {
+        return -1.0; // NULL Error occured 
+    }
+}
 
-TimeZone CoarseETA::timeZoning(const std::string& timestamp_str) {
-    TimeZone timeZone;
-    
-    // Parse the timestamp string the formate used for now is "%Y-%m-%d %H:%M:%S"
-    struct tm tm = {};
-    std::stringstream ss(timestamp_str);
-    ss >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
-    
-    if (ss.fail()) {
-        std::cerr << "Failed to parse timestamp: " << timestamp_str << std::endl;
-        return timeZone;
+// Process the ETA profile of a trip over its departure times
+std::vector<double> CoarseETA::ETASweepRequest(const ETAQuery& trip, const std::vector<std::string>& start_datetimes,
+                                               Timing& timing) const {
+    auto total_time_start = std::chrono::high_resolution_clock::now(); // start the timer for the total time
+    std::vector<uint64_t> time_bits(start_datetimes.size());
+    for (size_t i = 0; i < start_datetimes.size(); i++) {
+        try {
+            time_bits[i] = time_zoning.timeBits(start_datetimes[i]);
+        } catch (const std::exception& e) {
+            time_bits[i] = NO_TIME; // malformed timestamp
+        }
     }
+    return ETASweep(trip, time_bits, total_time_start, timing);
+}
+
+std::vector<double> CoarseETA::ETASweepRequest(const ETAQuery& trip, const std::vector<int64_t>& start_epochs,
+                                               Timing& timing) const {
+    auto total_time_start = std::chrono::high_resolution_clock::now(); // start the timer for the total time
+    std::vector<uint64_t> time_bits(start_epochs.size());
+    for (size_t i = 0; i < start_epochs.size(); i++) time_bits[i] = time_zoning.timeBits(start_epochs[i]);
+    return ETASweep(trip, time_bits, total_time_start, timing);
+}
 
-    
-    // Extract Time Zone
-    int month = tm.tm_mon + 1;  // Get the months in 1 to 12
-    int day_of_week = tm.tm_wday;  // 0-6 (Sunday=0)
-    int python_weekday = (day_of_week + 6) % 7;  // Convert to Monday=0, Sunday=6 as the dataset was prepared in python change if needed
-    timeZone.day_of_week = python_weekday;
-    timeZone.daytype = (python_weekday >= 5) ? "weekend" : "weekday"; // get daytype
-
-    // Get hour and round to the nearest hour (add 1 if minute > 30)
-    int hour = tm.tm_hour;
-    int minute = tm.tm_min;
-    int hour_adjustment = (minute > 30) ? 1 : 0;
-    timeZone.adjusted_hour = (hour + hour_adjustment) % 24;
-    
-    // Determine hour range periods
-    std::vector<std::pair<int, int>> ranges = {
-        {0, 6},    // Range 1: 00-06 Early Morning
-        {7, 10},   // Range 2: 07-10 Morning Peak
-        {11, 13},  // Range 3: 11-13 Noon Off Peak
-        {14, 16},  // Range 4: 14-16 Afternoon Peak
-        {17, 19},  // Range 5: 17-19 Evening Off Peak
-        {20, 23}   // Range 6: 20-23 Late Evening
+std::vector<double> CoarseETA::ETASweep(const ETAQuery& trip, const std::vector<uint64_t>& time_bits,
+                                        std::chrono::high_resolution_clock::time_point total_time_start,
+                                        Timing& timing) const {
+    HttpDeadline deadline = engineDeadline(std::chrono::steady_clock::now()); // budget of the sweep for its engine call
+    std::vector<double> etas(time_bits.size(), -1.0); // -1 for the times that cannot be answered
+    timing.routing_engine = 0;
+    auto finish = [&]() {
+        auto total_time_end = std::chrono::high_resolution_clock::now(); // end the timer for the total time
+        timing.total = std::chrono::duration<double, std::milli>(total_time_end - total_time_start).count();
+        timing.coarseETA = timing.total - timing.routing_engine;
+        return etas;
     };
-    
-    for (const auto& range : ranges) {
-        if (timeZone.adjusted_hour >= range.first && 
-            timeZone.adjusted_hour <= range.second) {
-            timeZone.start_hour = range.first;
-            timeZone.end_hour = range.second;
-            break;
+
+    if (field == ALL_FIELDS) return finish(); // no aggregate type set (see zoneQuery)
+
+    // STEP 1: Spatial zoning once, then the ground truth aggregates of every departure time
+    ZonedQuery zoned;
+    zoned.start_zone = spatial_index->findZoneIndex(trip.start_long, trip.start_lat);
+    zoned.end_zone = spatial_index->findZoneIndex(trip.end_long, trip.end_lat);
+    if (zoned.start_zone == ZoneStore::NO_ZONE || zoned.end_zone == ZoneStore::NO_ZONE) return finish();
+    size_t width = HashIndex::MAX_FIELD_VALUES;
+    std::vector<double> aggregates(time_bits.size() * width);
+    std::vector<char> found(time_bits.size(), 0);
+    bool answerable = false;
+    for (size_t i = 0; i < time_bits.size(); i++) {
+        if (time_bits[i] == NO_TIME) continue;
+        if (i && time_bits[i] == time_bits[i - 1]) { // same time zone as the previous departure time (e.g. in an hour range)
+            found[i] = found[i - 1];
+            std::copy(&aggregates[(i - 1) * width], &aggregates[i * width], &aggregates[i * width]);
+        } else {
+            found[i] = hash_index.find(zoned.start_zone, zoned.end_zone, time_bits[i], field, &aggregates[i * width]);
         }
+        answerable = answerable || found[i];
+    }
+    if (!answerable) return finish(); // no engine call for nothing to answer
+
+    // STEP 2: one routing engine call and one rank of os_eta in the SpatialETA table of the zone pair
+    auto engine_time_start = std::chrono::high_resolution_clock::now(); // start the timer for the routing engine time
+    double os_eta = OpenSourceRoutingEngine(trip.start_long, trip.start_lat, trip.end_long, trip.end_lat, deadline);
+    auto engine_time_end = std::chrono::high_resolution_clock::now(); // end the timer for the routing engine time
+    timing.routing_engine = std::chrono::duration<double, std::milli>(engine_time_end - engine_time_start).count();
+    double rank_percent = 0;
+    try {
+        if (os_eta != ENGINE_TIMED_OUT) rank_percent = rankPercent(*spatial_tables->get(zoned.start_zone, zoned.end_zone), os_eta);
+    } catch (const std::exception& e) {
+        return finish();
     }
 
+    // STEP 3: Output ETA of every departure time from its aggregates (or the deadline fallback if the engine ran out of time)
+    for (size_t i = 0; i < time_bits.size(); i++) {
+        if (!found[i]) continue;
+        try {
+            if (os_eta == ENGINE_TIMED_OUT) {
+                std::copy(&aggregates[i * width], &aggregates[(i + 1) * width], zoned.aggregates);
+                etas[i] = deadlineFallback(zoned);
+            } else {
+                etas[i] = aggregateETA(&aggregates[i * width], rank_percent);
+            }
+        } catch (const std::exception& e) {
+            etas[i] = -1.0;
+        }
+    }
+    return finish();
+}
 
-    // Determine season (1-4)
-    // Season 1: Winter (Dec, Jan, Feb) {12, 1, 2}
-    // Season 2: Spring (Mar, Apr, May) {3, 4, 5}
-    // Season 3: Summer (Jun, Jul, Aug) {6, 7, 8}
-    // Season 4: Fall (Sep, Oct, Nov) {9, 10, 11}
-    timeZone.season = ((month + 9) % 12) / 3 + 1;    
-    
-    return timeZone;
+// Process a batch of ETA requests with routing engine matrix calls instead of one route call per query
+std::vector<double> CoarseETA::ETABatchRequest(const std::vector<ETAQuery>& queries) const {
+    Timing timing;
+    return ETABatchRequest(queries, timing);
 }
 
-double CoarseETA::OpenSourceRoutingEngine(double start_long, double start_lat, 
-                                            double end_long, double end_lat) {
+std::vector<double> CoarseETA::ETABatchRequest(const std::vector<ETAQuery>& queries, Timing& timing) const {
+    auto total_time_start = std::chrono::high_resolution_clock::now(); // start the timer for the total time
+    HttpDeadline deadline = engineDeadline(std::chrono::steady_clock::now()); // budget of the whole batch for its engine calls
+    std::vector<double> etas(queries.size(), -1.0); // -1 for the queries that cannot be answered
+    timing.routing_engine = 0;
+
+    // STEP 1: Zoning and Aggregates of every query, the failed ones and the cached trips are not sent to the routing engine
+    std::vector<uint32_t> zones = zoneQueries(queries);
+    std::vector<ZonedQuery> zoned(queries.size());
+    std::vector<EngineCache::Key> keys(engine_cache ? queries.size() : 0);
+    std::vector<size_t> answerable;
+    std::map<std::pair<double, double>, uint32_t> source_ids, target_ids; // distinct origins and destinations
+    std::vector<uint32_t> query_source(queries.size()), query_target(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        try {
+            zoneQuery(queries[i], zoned[i], &zones[2 * i]);
+        } catch (const std::exception& e) {
+            continue;
+        }
+        if (engine_cache) {
+            keys[i] = engine_cache->key(queries[i].start_long, queries[i].start_lat, queries[i].end_long, queries[i].end_lat);
+            double cached;
+            if (engine_cache->find(keys[i], cached)) {
+                try {
+                    etas[i] = outputETA(zoned[i], cached);
+                } catch (const std::exception& e) {
+                    etas[i] = -1.0;
+                }
+                continue;
+            }
+        }
+        answerable.push_back(i);
+        query_source[i] = source_ids.emplace(std::make_pair(queries[i].start_long, queries[i].start_lat), source_ids.size()).first->second;
+        query_target[i] = target_ids.emplace(std::make_pair(queries[i].end_long, queries[i].end_lat), target_ids.size()).first->second;
+    }
 
-    // safe conversion from double to string without rounding for the coordinates
-    auto dbl2str = [](double v) {
-        char buf[32];
-        snprintf(buf, sizeof(buf), "%.17g", v);
-        return std::string(buf);
-    }; 
+    // Split the distinct origins and destinations into blocks of at most matrix_max_locations locations in total
+    // e.g. many origins against a few destinations keep all the destinations in every block
+    size_t max_locations = std::max<size_t>(matrix_max_locations, 2);
+    size_t block_sources, block_targets;
+    if (target_ids.size() <= max_locations / 2) {
+        block_targets = std::max<size_t>(target_ids.size(), 1);
+        block_sources = max_locations - block_targets;
+    } else if (source_ids.size() <= max_locations / 2) {
+        block_sources = std::max<size_t>(source_ids.size(), 1);
+        block_targets = max_locations - block_sources;
+    } else {
+        block_sources = max_locations / 2;
+        block_targets = max_locations - block_sources;
+    }
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<size_t>> blocks; // block -> its queries
+    for (size_t i : answerable)
+        blocks[{query_source[i] / block_sources, query_target[i] / block_targets}].push_back(i);
+
+    // STEP 2: one matrix call per block holding queries, over the locations its queries use
+    for (const auto& block : blocks) {
+        std::vector<Point> sources, targets;
+        std::map<uint32_t, uint32_t> local_source, local_target; // distinct location id -> row / column
+        for (size_t i : block.second) {
+            if (local_source.emplace(query_source[i], sources.size()).second)
+                sources.push_back({queries[i].start_long, queries[i].start_lat});
+            if (local_target.emplace(query_target[i], targets.size()).second)
+                targets.push_back({queries[i].end_long, queries[i].end_lat});
+        }
 
-    try {
-        if (engine == "osrm") { // call OSRM and return its resulting ETA
-            std::string path = "/route/v1/driving/"
-                + dbl2str(start_long) + "," + dbl2str(start_lat) + ";"
-
-                + dbl2str(end_long) + "," + dbl2str(end_lat)
-                + "?overview=false";
-            std::string resp = httpRequest(routingengine_server, 5000, "GET", path);
-            return parseRoutingEngineAnswerJson(resp, {"routes", "0", "duration"});
-
-        } else if (engine == "ors") { // call ORS and return its resulting ETA
-            std::string body = "{\"coordinates\":[[" 
-                + dbl2str(start_long) + "," + dbl2str(start_lat) + "],["
-                + dbl2str(end_long) + "," + dbl2str(end_lat) + "]]}";
-            std::string resp = httpRequest(routingengine_server, 8082, "POST",
-                                           "/ors/v2/directions/driving-car", body);
-            return parseRoutingEngineAnswerJson(resp, {"routes", "0", "summary", "duration"});
-
-        } else if (engine == "val") { // call Valhalla and return its resulting ETA
-            std::string body = "{\"locations\":["
-                "{\"lat\":" + dbl2str(start_lat) + ",\"lon\":" + dbl2str(start_long) + "},"
-                "{\"lat\":" + dbl2str(end_lat) + ",\"lon\":" + dbl2str(end_long) + "}],"
-                "\"costing\":\"auto\"}";
-            std::string resp = httpRequest(routingengine_server, 8002, "POST", "/route", body);
-            // Check for error_code 442 -> return -1
-            if (resp.find("\"error_code\"") != std::string::npos) {
-                double ec = parseRoutingEngineAnswerJson(resp, {"error_code"});
-                if ((int)ec == 442) return -1.0;
-                throw std::runtime_error("Valhalla error: " + resp);
+        auto engine_time_start = std::chrono::high_resolution_clock::now(); // start the timer for the routing engine time
+        std::vector<double> durations = OpenSourceRoutingEngineMatrix(sources, targets, deadline);
+        auto engine_time_end = std::chrono::high_resolution_clock::now(); // end the timer for the routing engine time
+        timing.routing_engine += std::chrono::duration<double, std::milli>(engine_time_end - engine_time_start).count();
+
+        // STEP 2 (rank of os_eta) and STEP 3: Output ETA, as for a single request
+        for (size_t i : block.second) {
+            double os_eta = durations[local_source[query_source[i]] * targets.size() + local_target[query_target[i]]];
+            if (engine_cache && os_eta >= 0) engine_cache->insert(keys[i], os_eta); // only routes, not errors
+            try {
+                etas[i] = (os_eta == ENGINE_TIMED_OUT) ? deadlineFallback(zoned[i]) : outputETA(zoned[i], os_eta);
+            } catch (const std::exception& e) {
+                etas[i] = -1.0;
             }
-            return parseRoutingEngineAnswerJson(resp, {"trip", "summary", "time"});
-
-        } else {
-            throw std::runtime_error("Unsupported engine: " + engine);
         }
-    } catch (const std::exception&) {
-        return -1.0; // if engine error occurs
     }
+
+    auto total_time_end = std::chrono::high_resolution_clock::now(); // end the timer for the total time
+    timing.total = std::chrono::duration<double, std::milli>(total_time_end - total_time_start).count();
+    timing.coarseETA = timing.total - timing.routing_engine;
+    return etas;
 }
 
-// Raw HTTP request over TCP for faster computations for testing
-std::string CoarseETA::httpRequest(const std::string& host, int port,
-                                const std::string& method,
-                                const std::string& path,
-                                const std::string& body) {
-    // Resolve host
-    struct hostent* he = gethostbyname(host.c_str());
-    if (!he) throw std::runtime_error("Cannot resolve host: " + host);
+// Process the ETA requests in parallel on the worker threads
+std::vector<double> CoarseETA::ETAParallelRequest(const std::vector<ETAQuery>& queries, std::vector<Timing>& timings) const {
+    std::vector<double> etas(queries.size());
+    timings.assign(queries.size(), Timing{});
+    std::vector<uint32_t> zones = zoneQueries(queries);
+    std::shared_ptr<WorkerPool> pool = workerPool();
+    pool->parallelFor(queries.size(), [&](size_t i) {
+        etas[i] = ETARequest(queries[i], timings[i], &zones[2 * i]);
+    });
+    return etas;
+}
+
+std::vector<uint32_t> CoarseETA::zoneQueries(const std::vector<ETAQuery>& queries) const {
+    std::vector<double> lon(2 * queries.size()), lat(2 * queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        lon[2 * i] = queries[i].start_long;
+        lat[2 * i] = queries[i].start_lat;
+        lon[2 * i + 1] = queries[i].end_long;
+        lat[2 * i + 1] = queries[i].end_lat;
+    }
+    std::vector<uint32_t> zones(lon.size());
+    std::shared_ptr<WorkerPool> pool = workerPool();
+    spatial_index->findZoneIndices(lon.data(), lat.data(), lon.size(), zones.data(), pool.get());
+    return zones;
+}
 
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) throw std::runtime_error("Socket creation failed");
+std::vector<uint32_t> CoarseETA::zonePoints(const std::vector<Point>& points) const {
+    std::vector<double> lon(points.size()), lat(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        lon[i] = points[i].lon;
+        lat[i] = points[i].lat;
+    }
+    std::vector<uint32_t> zones(points.size());
+    std::shared_ptr<WorkerPool> pool = workerPool();
+    spatial_index->findZoneIndices(lon.data(), lat.data(), points.size(), zones.data(), pool.get());
+    return zones;
+}
 
-    struct sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    memcpy(&addr.sin_addr, he->h_addr_list[0], he->h_length);
+// Process the ETA request in the async pipeline stages
+void CoarseETA::ETARequestAsync(const ETAQuery& query, std::function<void(ETAResponse)> done) const {
+    using Clock = std::chrono::high_resolution_clock;
+    auto total_time_start = Clock::now(); // start the timer for the total time (includes the queueing in the stages)
+    HttpDeadline deadline = engineDeadline(std::chrono::steady_clock::now()); // budget of the query for its engine call
 
-    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        close(sock);
-        throw std::runtime_error("Connection failed to " + host);
+    pre_engine->post([this, query, done, total_time_start, deadline]() {
+        // STEP 1: Zoning and Aggregates
+        auto zoned = std::make_shared<ZonedQuery>();
+        try {
+            zoneQuery(query, *zoned);
+        } catch (const std::exception& e) {
+            ETAResponse failed{-1.0, {}}; // NULL Error occured 
+            failed.timing.total = std::chrono::duration<double, std::milli>(Clock::now() - total_time_start).count();
+            failed.timing.coarseETA = failed.timing.total;
+            done(failed);
+            return;
+        }
+
+        // STEP 2: query the routing engine without blocking, and meanwhile map the SpatialETA table of the zone pair
+        // and prefetch its pages so the post-engine stage only touches warm memory
+        auto engine_time_start = std::make_shared<Clock::time_point>(Clock::now());
+        auto table = std::make_shared<SpatialETAStore::Handle>();
+        auto table_ready = std::make_shared<std::promise<void>>();
+        std::shared_future<void> table_mapped = table_ready->get_future().share();
+
+        OpenSourceRoutingEngineAsync(query.start_long, query.start_lat, query.end_long, query.end_lat,
+            [this, zoned, table, table_mapped, engine_time_start, total_time_start, done](double os_eta) {
+                auto engine_time_end = Clock::now(); // end the timer for the routing engine time
+                post_engine->post([this, zoned, table, table_mapped, engine_time_start, engine_time_end,
+                                   total_time_start, done, os_eta]() {
+                    // STEP 2 (rank of os_eta) and STEP 3: Output ETA
+                    table_mapped.wait();
+                    ETAResponse response{-1.0, {}};
+                    try {
+                        if (os_eta == ENGINE_TIMED_OUT) response.eta = deadlineFallback(*zoned);
+                        else response.eta = *table ? outputETA(*zoned, **table, os_eta) : outputETA(*zoned, os_eta);
+                    } catch (const std::exception& e) {
+                        response.eta = -1.0; // NULL Error occured 
+                    }
+                    auto total_time_end = Clock::now(); // end the timer for the total time
+                    response.timing.routing_engine = std::chrono::duration<double, std::milli>(engine_time_end - *engine_time_start).count();
+                    response.timing.total = std::chrono::duration<double, std::milli>(total_time_end - total_time_start).count();
+                    response.timing.coarseETA = response.timing.total - response.timing.routing_engine;
+                    done(response);
+                });
+            }, deadline);
+
+        try {
+            *table = spatial_tables->get(zoned->start_zone, zoned->end_zone);
+            SpatialETAStore::prefetch(**table, prefetch_max_bytes);
+        } catch (const std::exception& e) {
+            table->reset(); // the post-engine stage reports the error
+        }
+        table_ready->set_value();
+    });
+}
+
+std::future<ETAResponse> CoarseETA::ETARequestAsync(const ETAQuery& query) const {
+    auto promise = std::make_shared<std::promise<ETAResponse>>();
+    std::future<ETAResponse> result = promise->get_future();
+    ETARequestAsync(query, [promise](ETAResponse response) { promise->set_value(response); });
+    return result;
+}
+
+void CoarseETA::setAsyncPipeline(size_t pre_engine_threads, size_t post_engine_threads, size_t prefetch_kb) {
+    pre_engine = std::make_unique<Executor>(pre_engine_threads);
+    post_engine = std::make_unique<Executor>(post_engine_threads);
+    prefetch_max_bytes = prefetch_kb << 10;
+}
+
+void CoarseETA::setEngineMatrixLimit(size_t max_locations) {
+    matrix_max_locations = max_locations;
+}
+
+void CoarseETA::zoneQuery(const ETAQuery& query, ZonedQuery& zoned, const uint32_t* zones) const {
+    if (field == ALL_FIELDS) throw std::logic_error("No aggregate type set, call setAggregateTypeField first");
+    // Spatial Zoning
+    zoned.start_zone = zones ? zones[0] : spatial_index->findZoneIndex(query.start_long, query.start_lat); // find the dense index of the spatial zone corresponding to the starting point
+    zoned.end_zone = zones ? zones[1] : spatial_index->findZoneIndex(query.end_long, query.end_lat); // find the dense index of the spatial zone corresponding to the ending point
+    if (zoned.start_zone == ZoneStore::NO_ZONE || zoned.end_zone == ZoneStore::NO_ZONE) throw std::out_of_range("Point outside the zones");
+    // Temporal Zoning
+    // season, day of week or daytype, hour of day rounded to the nearest hour or its hour range, throws on a malformed timestamp
+    uint64_t time_bits = query.start_epoch >= 0 ? time_zoning.timeBits(query.start_epoch) : time_zoning.timeBits(query.start_datetime);
+
+    // Look up the packed key in the hash table index to get the ground truth aggregates using the spatial and temporal zones based on the requested temporal zoning type
+    if (!hash_index.find(zoned.start_zone, zoned.end_zone, time_bits, field, zoned.aggregates))
+        throw std::out_of_range("Key not found in the hash index");
+}
+
+double CoarseETA::outputETA(const ZonedQuery& zoned, double os_eta) const {
+    // Get the mapped spatial eta table of the start and end zones (from the folder pool or the archive)
+    SpatialETAStore::Handle handle = spatial_tables->get(zoned.start_zone, zoned.end_zone);
+    return outputETA(zoned, *handle, os_eta);
+}
+
+double CoarseETA::outputETA(const ZonedQuery& zoned, const SpatialETATable& table, double os_eta) const {
+    return aggregateETA(zoned.aggregates, rankPercent(table, os_eta));
+}
+
+double CoarseETA::rankPercent(const SpatialETATable& table, double os_eta) const {
+    SearchResult search_result = binarySearchETA(table, os_eta); // search the spatial ETA table corresponding to the start and end zones for os_eta rank
+
+    // interpolate the rank if an exact match was not found, an exact match of tied knots of a sketch ranks at the middle of the run
+    double rank = search_result.record_eta1 + search_result.ties / 2.0;
+    if (search_result.record_eta2 != -1) {
+        rank = rank + (os_eta - search_result.eta1) / (search_result.eta2 - search_result.eta1);
     }
+    // calculate the rank in percentage where rank here is 0-indexed
+    double rank_percent = 0;
+    if (search_result.total_records > 1)
+        rank_percent = ((rank) / ((double)search_result.total_records-1)) * 100;
+    return rank_percent;
+}
 
-    // Build HTTP request
-    std::string request;
-    if (method == "POST") {
-        request = "POST " + path + " HTTP/1.0\r\n"
-                  "Host: " + host + "\r\n"
-                  "Content-Type: application/json\r\n"
-                  "Content-Length: " + std::to_string(body.size()) + "\r\n"
-                  "Connection: close\r\n\r\n" + body;
-    } else {
-        request = "GET " + path + " HTTP/1.0\r\n"
-                  "Host: " + host + "\r\n"
-                  "Connection: close\r\n\r\n";
+double CoarseETA::aggregateETA(const double* aggregates, double rank_percent) const {
+    // Get the ground truth aggregate values and percentiles
+    const std::vector<double>& aggeregate_list_x = *ranks; // percentiles/ranks
+    const double* aggeregate_list_y = aggregates; // ground truth values from the hash table
+
+    // STEP 3: Output ETA
+    // search the ground truth aggregate list for the rank percentage
+    StatResult stat_result = FindStat(aggeregate_list_x.data(), aggeregate_list_y, aggeregate_list_x.size(), rank_percent); 
+
+    // calculate the output eta as the value corresponding to the rank percentage
+    // if exact match is not found interpolate the eta
+    double final_eta = stat_result.eta1;
+    if (stat_result.rank2 != -1) {
+        final_eta = stat_result.eta1 + (stat_result.eta2 - stat_result.eta1) * ((rank_percent - stat_result.rank1) / (stat_result.rank2 - stat_result.rank1));
     }
+    return final_eta;
+}
+
+
+double CoarseETA::OpenSourceRoutingEngine(double start_long, double start_lat, 
+                                            double end_long, double end_lat, HttpDeadline deadline) const {
+    double os_eta = -1.0; // if engine error occurs
+    try {
+        if (!backend) throw std::runtime_error("Unsupported engine: " + engine);
+        if (backend->inProcess()) return backend->route(start_long, start_lat, end_long, end_lat);
+        // a cached ETA of the snapped trip skips the engine call
+        EngineCache::Key key{};
+        double cached;
+        if (engine_cache) {
+            key = engine_cache->key(start_long, start_lat, end_long, end_lat);
+            if (engine_cache->find(key, cached)) return cached;
+        }
+        EngineRequest request = backend->routeRequest(start_long, start_lat, end_long, end_lat);
+
+        // an identical call already in flight answers this one too
+        std::string flight = flightKey(request);
+        auto shared = std::make_shared<std::promise<double>>();
+        if (engine_flights && !engine_flights->join(flight, [shared](double eta) { shared->set_value(eta); })) {
+            std::future<double> answer = shared->get_future();
+            if (deadline != HttpDeadline::max() && answer.wait_until(deadline) == std::future_status::timeout)
+                return ENGINE_TIMED_OUT;
+            os_eta = answer.get();
+            if (os_eta != ENGINE_LEADER_TIMED_OUT) return os_eta;
+            // the leader timed out: one call of our own within the time we have left, not coalesced again
+            if (!retryAfterLeader(deadline)) return ENGINE_TIMED_OUT;
+            os_eta = routeCall(request, deadline);
+            if (engine_cache && os_eta >= 0) engine_cache->insert(key, os_eta);
+            return os_eta;
+        }
+
+        os_eta = routeCall(request, deadline);
+        if (engine_cache && os_eta >= 0) engine_cache->insert(key, os_eta); // only routes, not errors
+        if (engine_flights) engine_flights->complete(flight, os_eta == ENGINE_TIMED_OUT ? ENGINE_LEADER_TIMED_OUT : os_eta);
+    } catch (const std::exception&) {}
+    return os_eta;
+}
 
-    // Send Request
-    if (send(sock, request.c_str(), request.size(), 0) < 0) {
-        close(sock);
-        throw std::runtime_error("Send failed");
+double CoarseETA::routeCall(const EngineRequest& request, HttpDeadline deadline) const {
+    try {
+        // stop reading a large answer once its ETA went by (e.g. before the geometry)
+        std::string_view answer_path = backend->routeAnswerPath();
+        std::string resp = engine_replicas->call(request.method, request.path, request.body, deadline,
+            [answer_path](std::string_view received) {
+                double eta;
+                return JsonExtract::number(received, answer_path, eta) != JsonExtract::INCOMPLETE;
+            });
+        return backend->parseRouteAnswer(resp);
+    } catch (const HttpTimeout&) {
+        return ENGINE_TIMED_OUT;
+    } catch (const std::exception&) {
+        return -1.0; // if engine error occurs
     }
+}
 
-    // Receive response
-    std::string response;
-    char buf[4096];
-    int n;
-    while ((n = recv(sock, buf, sizeof(buf), 0)) > 0)
-        response.append(buf, n);
-    close(sock);
-
-    // Strip HTTP headers
-    size_t header_end = response.find("\r\n\r\n");
-    if (header_end == std::string::npos)
-        throw std::runtime_error("Malformed HTTP response");
-    return response.substr(header_end + 4);
-}
-
-
-double CoarseETA::parseRoutingEngineAnswerJson(const std::string& json, const std::vector<std::string>& path) {
-    size_t pos = 0;
-    size_t end = json.size();
-
-    for (const auto& key : path) { // go through the keys determined based on the engine used 
-        // Skip whitespace
-        while (pos < end && isspace(json[pos])) pos++;
-
-        if (json[pos] == '{') {
-            // Object: find "key":
-            std::string search = "\"" + key + "\"";
-            size_t found = json.find(search, pos);
-            if (found == std::string::npos || found >= end)
-                throw std::runtime_error("Key not found: " + key);
-            pos = found + search.size();
-            // Skip to ':'
-            pos = json.find(':', pos) + 1;
-            while (pos < end && isspace(json[pos])) pos++;
-
-        } else if (json[pos] == '[') {
-            // Array: advance to the Nth element
-            int idx = std::stoi(key);
-            pos++; // skip '['
-            for (int i = 0; i < idx; i++) {
-                int depth = 0;
-                bool in_string = false;
-                while (pos < end) {
-                    char c = json[pos++];
-                    if (c == '\\' && in_string) { pos++; continue; }
-                    if (c == '"') { in_string = !in_string; continue; }
-                    if (in_string) continue;
-                    if (c == '{' || c == '[') depth++;
-                    else if (c == '}' || c == ']') depth--;
-                    else if (c == ',' && depth == 0) break;
-                }
-                while (pos < end && isspace(json[pos])) pos++;
+void CoarseETA::routeCallAsync(const EngineRequest& request, HttpDeadline deadline, std::function<void(double)> done) const {
+    engine_replicas->callAsync(request.method, request.path, request.body,
+        [this, done](std::string resp, std::exception_ptr error) {
+            double os_eta = -1.0; // if engine error occurs
+            try {
+                if (error) std::rethrow_exception(error);
+                os_eta = backend->parseRouteAnswer(resp);
+            } catch (const HttpTimeout&) {
+                os_eta = ENGINE_TIMED_OUT;
+            } catch (const std::exception&) {}
+            done(os_eta);
+        }, deadline);
+}
+
+void CoarseETA::OpenSourceRoutingEngineAsync(double start_long, double start_lat, double end_long, double end_lat,
+                                             std::function<void(double)> done, HttpDeadline deadline) const {
+    EngineRequest request;
+    try {
+        if (!backend) throw std::runtime_error("Unsupported engine: " + engine);
+        if (backend->inProcess()) {
+            done(backend->route(start_long, start_lat, end_long, end_lat));
+            return;
+        }
+        // a cached ETA of the snapped trip completes at once without an engine call
+        EngineCache::Key key{};
+        double cached;
+        if (engine_cache) {
+            key = engine_cache->key(start_long, start_lat, end_long, end_lat);
+            if (engine_cache->find(key, cached)) {
+                done(cached);
+                return;
             }
-        } else {
-            throw std::runtime_error("Expected object or array at pos " + std::to_string(pos));
         }
+        request = backend->routeRequest(start_long, start_lat, end_long, end_lat);
+
+        // an identical call already in flight answers this one too
+        std::string flight = flightKey(request);
+        auto follow = [this, request, key, done, deadline](double eta) {
+            if (eta != ENGINE_LEADER_TIMED_OUT) {
+                done(eta);
+            } else if (!retryAfterLeader(deadline)) {
+                done(ENGINE_TIMED_OUT);
+            } else { // the leader timed out: one call of our own within the time we have left, not coalesced again
+                routeCallAsync(request, deadline, [this, key, done](double os_eta) {
+                    if (engine_cache && os_eta >= 0) engine_cache->insert(key, os_eta);
+                    done(os_eta);
+                });
+            }
+        };
+        if (engine_flights && !engine_flights->join(flight, follow)) return;
+
+        routeCallAsync(request, deadline, [this, done, key, flight](double os_eta) {
+            if (engine_cache && os_eta >= 0) engine_cache->insert(key, os_eta);
+            // the callers that joined meanwhile get it too
+            if (engine_flights) engine_flights->complete(flight, os_eta == ENGINE_TIMED_OUT ? ENGINE_LEADER_TIMED_OUT : os_eta);
+            done(os_eta);
+        });
+    } catch (const std::exception&) {
+        done(-1.0);
     }
+}
 
-    // pos now points at the target value — parse double
-    while (pos < end && isspace(json[pos])) pos++;
-    return std::stod(json.substr(pos));
+std::future<double> CoarseETA::OpenSourceRoutingEngineAsync(double start_long, double start_lat,
+                                                            double end_long, double end_lat, HttpDeadline deadline) const {
+    auto promise = std::make_shared<std::promise<double>>();
+    std::future<double> result = promise->get_future();
+    OpenSourceRoutingEngineAsync(start_long, start_lat, end_long, end_lat,
+                                 [promise](double os_eta) { promise->set_value(os_eta); }, deadline);
+    return result;
 }
 
+std::string CoarseETA::flightKey(const EngineRequest& request) {
+    return request.method + " " + request.path + "\n" + request.body;
+}
 
-SearchResult CoarseETA::binarySearchETA(const std::string& zone1,
-                              const std::string& zone2,
-                              double os_eta) {
-    SearchResult result{};
- 
-    // Compose the filename of the spatial eta table bin file using the start and end zones
-    std::string filename = spatialETA_path + "/" + zone1 + "_" + zone2 + ".bin";
+std::vector<double> CoarseETA::OpenSourceRoutingEngineMatrix(const std::vector<Point>& sources,
+                                                             const std::vector<Point>& targets,
+                                                             HttpDeadline deadline) const {
+    try {
+        if (!backend) throw std::runtime_error("Unsupported engine: " + engine);
+        if (backend->inProcess()) return backend->matrix(sources, targets);
+        EngineRequest request = backend->matrixRequest(sources, targets);
+        std::string resp = engine_replicas->call(request.method, request.path, request.body, deadline);
+        return backend->parseMatrixAnswer(resp, sources.size(), targets.size());
+    } catch (const HttpTimeout&) {
+        return std::vector<double>(sources.size() * targets.size(), ENGINE_TIMED_OUT);
+    } catch (const std::exception&) {
+        return std::vector<double>(sources.size() * targets.size(), -1.0); // if engine error occurs
+    }
+}
 
-    FILE* f = fopen(filename.c_str(), "rb");
-    if (!f) throw std::runtime_error("Cannot open file: " + filename);
+SearchResult CoarseETA::binarySearchETA(const SpatialETATable& table,
+                              double os_eta) const {
+    SearchResult result{};
 
     // Get total records
-    if (fseeko(f, 0, SEEK_END) != 0) { fclose(f); throw std::runtime_error("fseeko SEEK_END failed"); }
-    off_t file_size = ftello(f);
-    if (file_size < 0) { fclose(f); throw std::runtime_error("ftello failed"); }
-    long long total = (long long)file_size / (long long)record_size;
+    long long total = table.total;
     result.total_records = total;
 
     if (total == 0) {
-        fclose(f);
         return result;
     }
 
@@ -381,24 +750,44 @@ SearchResult CoarseETA::binarySearchETA(const std::string& zone1,
     long long lo = 0, hi = total - 1;
     long long mid = 0;
     double mid_eta = 0.0;
+    long long node = 0; // node of mid in the search tree, the top levels are probed in memory instead of the table
  
     result.record_eta2 = -1;
     result.eta2 = -1.0;
 
     while (lo <= hi) {
         mid = lo + (hi - lo) / 2;
-        mid_eta = readETA(f, mid);
+        mid_eta = (node < table.tree_size) ? table.tree[node] : table.eta(mid);
 
         if (mid_eta == os_eta) {
             // Exact match
-            fclose(f);
             result.record_eta1 = mid;
             result.eta1 = mid_eta;
+            if (table.quantile_intervals == 0) return result;
+
+            // in a quantile sketch, the whole run of tied knots around mid lies in [lo, hi] as the knots before lo
+            // are < os_eta and the ones after hi > os_eta, find its ends so the rank does not depend on where the
+            // search landed in the run (a run of knots stands for a long run of tied records, e.g. whole seconds)
+            long long first = lo, last = hi;
+            for (long long end = mid; first < end;) {
+                long long m = first + (end - first) / 2;
+                if (table.eta(m) < os_eta) first = m + 1;
+                else end = m;
+            }
+            for (long long begin = mid; begin < last;) {
+                long long m = last - (last - begin) / 2;
+                if (table.eta(m) > os_eta) last = m - 1;
+                else begin = m;
+            }
+            result.record_eta1 = first;
+            result.ties = last - first;
             return result;
         } else if (mid_eta < os_eta) {
             lo = mid + 1;
+            node = 2 * node + 2;
         } else {
             hi = mid - 1;
+            node = 2 * node + 1;
         }
     }
     //If no exact match is found
@@ -408,50 +797,34 @@ SearchResult CoarseETA::binarySearchETA(const std::string& zone1,
         // os_eta is outside the range of the file (more than the max eta)
         // then snap it to the max eta as an exact match
         result.record_eta1 = total - 1;
-        result.eta1 = readETA(f, total - 1);
-        fclose(f);
+        result.eta1 = table.eta(total - 1);
         return result;
     } else if (hi < 0) {
         // os_eta is outside the range of the file (less than the min eta)
         // then snap it to the min eta as an exact match
         result.record_eta1 = 0;
-        result.eta1 = readETA(f, 0);
-        fclose(f);
+        result.eta1 = table.eta(0);
         return result;
     }
 
-    double eta1 = readETA(f, hi);   // ETA1 < os_eta
-    double eta2 = readETA(f, lo);   // ETA2 > os_eta
-
-    fclose(f);
-
     result.record_eta1 = hi;
-    result.eta1        = eta1;
+    result.eta1        = table.eta(hi);   // ETA1 < os_eta
     result.record_eta2 = lo;
-    result.eta2        = eta2;
+    result.eta2        = table.eta(lo);   // ETA2 > os_eta
 
     return result;
 }
 
 
-double CoarseETA::readETA(FILE* f, long long record_idx) { // read the eta at the record idx
-    if (fseeko(f, (off_t)(record_idx * record_size + eta_offset), SEEK_SET) != 0)
-        throw std::runtime_error("fseeko failed");
-    double eta;
-    if (fread(&eta, sizeof(double), 1, f) != 1)
-        throw std::runtime_error("fread failed");
-    return eta;
-}
-
-
-StatResult CoarseETA::FindStat(const std::vector<double>& x, // percentile ranks, e.g. {0, 25, 50, 75, 100}
-                               const std::vector<double>& y, // corresponding ground truth aggregate list / ETA values
-                               double rank_p) {
+StatResult CoarseETA::FindStat(const double* x, // percentile ranks, e.g. {0, 25, 50, 75, 100}
+                               const double* y, // corresponding ground truth aggregate list / ETA values
+                               size_t n,        // number of ranks / values
+                               double rank_p) const {
 
     // Binary search on percentile ranks x for rank_p
     // This is in case CoarseETA receives percentiles > 5 values or full distribution
-    const double* lo = x.data();
-    const double* hi = x.data() + x.size();
+    const double* lo = x;
+    const double* hi = x + n;
 
     const double* it = std::lower_bound(lo, hi, rank_p);
     size_t idx = it - lo;
@@ -469,7 +842,7 @@ StatResult CoarseETA::FindStat(const std::vector<double>& x, // percentile ranks
             res.rank1 = x[idx - 1];
             res.eta1  = y[idx - 1];
         }
-        if (idx < x.size()) {
+        if (idx < n) {
             res.rank2 = x[idx];
             res.eta2  = y[idx];
         }
@@ -0,0 +1,62 @@
+#include "../headers/EngineCache.hpp"
+#include "../headers/HashIndex.hpp"
+#include <cmath>
+#include <functional>
+
+
+EngineCache::EngineCache(const std::string& engine, size_t max_entries, int precision, double ttl_seconds, size_t shard_count)
+    : engine_tag(std::hash<std::string>()(engine)),
+      scale(std::pow(10.0, precision)),
+      ttl(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(ttl_seconds))) {
+    if (shard_count == 0) shard_count = 1;
+    shard_capacity = std::max<size_t>(1, (max_entries + shard_count - 1) / shard_count);
+    for (size_t i = 0; i < shard_count; i++) shards.push_back(std::make_unique<Shard>());
+}
+
+EngineCache::Key EngineCache::key(double start_long, double start_lat, double end_long, double end_lat) const {
+    return {std::llround(start_long * scale), std::llround(start_lat * scale),
+            std::llround(end_long * scale), std::llround(end_lat * scale), engine_tag};
+}
+
+size_t EngineCache::KeyHash::operator()(const Key& k) const {
+    uint64_t h = k.engine;
+    for (int64_t v : {k.start_long, k.start_lat, k.end_long, k.end_lat})
+        h = FlatHashIndex::hash(h ^ static_cast<uint64_t>(v));
+    return static_cast<size_t>(h);
+}
+
+bool EngineCache::find(const Key& key, double& eta) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        if (it->second->second.expires > Clock::now()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second); // mark as most recently used
+            eta = it->second->second.eta;
+            hit_count++;
+            return true;
+        }
+        shard.lru.erase(it->second); // expired
+        shard.entries.erase(it);
+    }
+    miss_count++;
+    return false;
+}
+
+void EngineCache::insert(const Key& key, double eta) {
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry entry{eta, Clock::now() + ttl};
+    auto it = shard.entries.find(key);
+    if (it != shard.entries.end()) {
+        it->second->second = entry;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    shard.lru.emplace_front(key, entry);
+    shard.entries[key] = shard.lru.begin();
+    if (shard.lru.size() > shard_capacity) { // drop the least recently used
+        shard.entries.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+    }
+}
@@ -0,0 +1,221 @@
+#include "../headers/EngineReplicas.hpp"
+#include <algorithm>
+#include <condition_variable>
+
+
+struct EngineReplicas::AsyncCall {
+    std::string method, path, body;
+    AsyncHttpClient::Callback done;
+    HttpDeadline deadline;
+    size_t first;               // replica of the first attempt
+    Clock::time_point start;
+};
+
+EngineReplicas::EngineReplicas(const std::string& servers, int default_port) {
+    size_t begin = 0;
+    while (begin <= servers.size()) {
+        size_t end = servers.find(',', begin);
+        if (end == std::string::npos) end = servers.size();
+        std::string server = servers.substr(begin, end - begin);
+        server.erase(0, server.find_first_not_of(" \t"));
+        server.erase(server.find_last_not_of(" \t") + 1);
+        if (!server.empty()) {
+            Replica replica;
+            size_t colon = server.rfind(':');
+            if (colon != std::string::npos && server.find(':') == colon) { // host:port (not a bare IPv6 address)
+                replica.host = server.substr(0, colon);
+                replica.port = std::stoi(server.substr(colon + 1));
+            } else {
+                replica.host = server;
+                replica.port = default_port;
+            }
+            replicas.push_back(std::move(replica));
+        }
+        begin = end + 1;
+    }
+    if (replicas.empty()) throw std::invalid_argument("No routing engine server in: " + servers);
+    setPoolSize(4);
+    setAsync(max_connections, pipeline_depth);
+}
+
+EngineReplicas::~EngineReplicas() {
+    {
+        std::unique_lock<std::shared_mutex> lock(lifecycle);
+        stopping = true; // the calls failed by the stopping clients below do not fall over to another one
+    }
+    for (auto& replica : replicas) replica.async_client.reset();
+}
+
+void EngineReplicas::setPoolSize(size_t pool_size) {
+    for (auto& replica : replicas) {
+        replica.client = std::make_unique<HttpClient>(replica.host, replica.port, pool_size);
+        replica.client->setTimeouts(connect_timeout_ms, read_timeout_ms);
+    }
+}
+
+void EngineReplicas::setAsync(size_t connections, size_t depth) {
+    max_connections = connections;
+    pipeline_depth = depth;
+    for (auto& replica : replicas) {
+        replica.async_client = std::make_unique<AsyncHttpClient>(replica.host, replica.port, connections, depth);
+        replica.async_client->setTimeouts(connect_timeout_ms, read_timeout_ms);
+    }
+}
+
+void EngineReplicas::setTimeouts(int connect_timeout, int read_timeout) {
+    connect_timeout_ms = connect_timeout;
+    read_timeout_ms = read_timeout;
+    for (auto& replica : replicas) {
+        replica.client->setTimeouts(connect_timeout_ms, read_timeout_ms);
+        replica.async_client->setTimeouts(connect_timeout_ms, read_timeout_ms);
+    }
+}
+
+void EngineReplicas::setHedging(double percentile) {
+    hedge_percentile = std::min(std::max(percentile, 0.0), 100.0);
+}
+
+void EngineReplicas::recordLatency(Clock::time_point start) {
+    if (hedge_percentile <= 0 || replicas.size() < 2) return;
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(latency_mutex);
+    if (latencies.size() < LATENCY_WINDOW) latencies.push_back(ms);
+    else latencies[latency_count % LATENCY_WINDOW] = ms;
+    latency_count++;
+}
+
+bool EngineReplicas::hedgeDelay(double& delay_ms) {
+    std::vector<double> window;
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex);
+        if (latencies.size() < MIN_LATENCY_SAMPLES) return false;
+        window = latencies;
+    }
+    size_t k = std::min(window.size() - 1, static_cast<size_t>(hedge_percentile / 100.0 * (window.size() - 1) + 0.5));
+    std::nth_element(window.begin(), window.begin() + k, window.end());
+    delay_ms = window[k];
+    return true;
+}
+
+std::string EngineReplicas::call(const std::string& method, const std::string& path, const std::string& body,
+                                 HttpDeadline deadline, const HttpClient::BodyCheck& enough) {
+    size_t first = next++ % replicas.size();
+    double delay_ms;
+    if (hedge_percentile > 0 && replicas.size() > 1 && hedgeDelay(delay_ms))
+        return hedgedCall(first, delay_ms, method, path, body, deadline);
+
+    // blocking keep-alive connections, falling over to the next replica while the deadline allows
+    auto start = Clock::now();
+    std::exception_ptr error;
+    for (size_t k = 0; k < replicas.size(); k++) {
+        try {
+            std::string response = replicas[(first + k) % replicas.size()].client->request(method, path, body, deadline, enough);
+            recordLatency(start);
+            return response;
+        } catch (const std::exception&) {
+            error = std::current_exception();
+        }
+        if (Clock::now() >= deadline) break;
+    }
+    std::rethrow_exception(error);
+}
+
+std::string EngineReplicas::hedgedCall(size_t first, double delay_ms, const std::string& method, const std::string& path,
+                                       const std::string& body, HttpDeadline deadline) {
+    // the first answer of the replicas sent to (on their async clients, the blocking call only waits)
+    struct Race {
+        std::mutex mutex;
+        std::condition_variable answered_cv;
+        bool answered = false;
+        std::string body;
+        std::exception_ptr error; // of the last failed replica
+        size_t sent = 0, failed = 0;
+    };
+    auto race = std::make_shared<Race>();
+    auto send = [&](size_t replica) {
+        {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            race->sent++;
+        }
+        auto done = [race](std::string response, std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(race->mutex);
+            if (race->answered) return; // the loser of the race
+            if (error) {
+                race->failed++;
+                race->error = error;
+            } else {
+                race->answered = true;
+                race->body = std::move(response);
+            }
+            race->answered_cv.notify_all();
+        };
+        try {
+            replicas[replica].async_client->request(method, path, body, done, deadline);
+        } catch (const std::exception&) {
+            done({}, std::current_exception());
+        }
+    };
+
+    auto start = Clock::now();
+    auto hedge_at = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(delay_ms));
+    send(first);
+    size_t tried = 1;
+    std::unique_lock<std::mutex> lock(race->mutex);
+    while (!race->answered) {
+        auto now = Clock::now();
+        bool all_failed = race->failed == race->sent;
+        // hedge once past the delay, and fall over to the next replica whenever all those tried failed
+        if ((all_failed || (tried == 1 && now >= hedge_at)) && tried < replicas.size() && now < deadline) {
+            if (!all_failed) hedged++;
+            lock.unlock();
+            send((first + tried++) % replicas.size());
+            lock.lock();
+            continue;
+        }
+        if (all_failed) std::rethrow_exception(race->error);
+        if (now >= deadline) throw HttpTimeout("Deadline exceeded waiting for the routing engine replicas");
+        auto wake = (tried == 1 && tried < replicas.size()) ? std::min(hedge_at, deadline) : deadline;
+        if (wake == HttpDeadline::max()) race->answered_cv.wait(lock);
+        else race->answered_cv.wait_until(lock, wake);
+    }
+    recordLatency(start);
+    return std::move(race->body);
+}
+
+void EngineReplicas::callAsync(const std::string& method, const std::string& path, const std::string& body,
+                               AsyncHttpClient::Callback done, HttpDeadline deadline) {
+    auto call = std::make_shared<AsyncCall>(AsyncCall{method, path, body, std::move(done), deadline,
+                                                      next++ % replicas.size(), Clock::now()});
+    sendAsync(call, 0);
+}
+
+void EngineReplicas::sendAsync(std::shared_ptr<AsyncCall> call, size_t attempt) {
+    for (;; attempt++) {
+        std::exception_ptr error;
+        try {
+            replicas[(call->first + attempt) % replicas.size()].async_client->request(call->method, call->path, call->body,
+                [this, call, attempt](std::string response, std::exception_ptr error) {
+                    if (!error) {
+                        recordLatency(call->start);
+                        call->done(std::move(response), nullptr);
+                        return;
+                    }
+                    if (attempt + 1 < replicas.size() && Clock::now() < call->deadline) {
+                        std::shared_lock<std::shared_mutex> lock(lifecycle);
+                        if (!stopping) {
+                            sendAsync(call, attempt + 1); // fall over to the next replica
+                            return;
+                        }
+                    }
+                    call->done({}, error);
+                }, call->deadline);
+            return;
+        } catch (const std::exception&) {
+            error = std::current_exception(); // the replica cannot be resolved
+        }
+        if (attempt + 1 >= replicas.size() || Clock::now() >= call->deadline) {
+            call->done({}, error);
+            return;
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#include "../headers/Executor.hpp"
+
+
+Executor::Executor(size_t threads) : thread_count(threads ? threads : 1) {}
+
+Executor::~Executor() {
+    std::vector<std::thread> running;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        running.swap(threads); // started by whichever thread posted first
+    }
+    ready.notify_all();
+    for (auto& t : running) t.join();
+}
+
+void Executor::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < thread_count; i++) threads.emplace_back(&Executor::work, this);
+}
+
+void Executor::post(std::function<void()> task) {
+    std::call_once(started, &Executor::start, this);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+}
+
+void Executor::work() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return; // stopping and drained
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
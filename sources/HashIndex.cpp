@@ -0,0 +1,344 @@
+#include "../headers/HashIndex.hpp"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <charconv>
+
+
+void FlatHashIndex::reserve(size_t n) {
+    size_t capacity = 16;
+    while (capacity < n * 2) capacity <<= 1;
+    if (capacity <= slots.size()) return;
+
+    // rehash the existing entries into the larger table
+    std::vector<Slot> old(capacity, Slot{HashKey::EMPTY, 0});
+    old.swap(slots);
+    table = slots.data();
+    mask = capacity - 1;
+    count = 0;
+    for (const Slot& s : old) {
+        if (s.key != HashKey::EMPTY) insert(s.key, s.value);
+    }
+}
+
+void FlatHashIndex::insert(uint64_t key, uint64_t value) {
+    if ((count + 1) * 2 > slots.size()) reserve(count + 1);
+
+    for (uint64_t i = hash(key) & mask;; i = (i + 1) & mask) {
+        Slot& s = slots[i];
+        if (s.key == key) { s.value = value; return; } // same as std::map operator[]: last one wins
+        if (s.key == HashKey::EMPTY) {
+            s.key = key;
+            s.value = value;
+            count++;
+            return;
+        }
+    }
+}
+
+void FlatHashIndex::attach(const Slot* data, size_t capacity, size_t entries) {
+    slots.clear();
+    slots.shrink_to_fit();
+    table = data;
+    mask = capacity - 1;
+    count = entries;
+}
+
+
+HashIndex::HashIndex(TimeZoningType time_zoning_type, const std::vector<std::string>& zone_ids)
+    : time_zoning_type(time_zoning_type),
+      runtime_zones(zone_ids),
+      intern_zones(zone_ids.empty())
+{
+    if (runtime_zones.size() > HashKey::MAX_ZONES) throw std::runtime_error("Too many zones for the packed hash key");
+}
+
+void HashIndex::load(const std::string& path) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open()) throw std::runtime_error("Cannot open hash index: " + path);
+    char magic[8] = {};
+    f.read(magic, sizeof(magic));
+    f.close();
+
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) == 0) loadV2(path);
+    else                                          loadV1(path);
+}
+
+void HashIndex::loadV1(const std::string& path) {
+    // the keys use the distinct runtime zone ids as their dense zone indices (a zone id can span several csv rows)
+    zone_names.clear();
+    zone_lookup.clear();
+    for (const auto& id : runtime_zones)
+        if (zone_lookup.emplace(id, static_cast<uint32_t>(zone_names.size())).second) zone_names.push_back(id);
+
+    std::ifstream f(path, std::ios::binary);
+    uint64_t num_entries; // How many entries to load
+    f.read(reinterpret_cast<char*>(&num_entries), 8);
+    std::cout << "Loading Hash table index with " << num_entries << " entries...\n";
+    table.reserve(num_entries);
+    stored_field = ALL_FIELDS;
+    precision = F64;
+    entry_bytes = VALUES_PER_ENTRY * sizeof(double);
+    owned_values.reserve(num_entries * entry_bytes);
+    uint64_t skipped = 0; // entries of zones that are not in the zones csv or malformed keys
+
+    std::string key;
+    for (uint64_t i = 0; i < num_entries; ++i) {
+        uint32_t key_len; // get key
+        f.read(reinterpret_cast<char*>(&key_len), 4);
+        key.assign(key_len, '\0');
+        f.read(&key[0], key_len);
+
+        double buffer[VALUES_PER_ENTRY]; // get values 2 (min_max) + 3 (min_med_max) + 5 (percentiles)
+        f.read(reinterpret_cast<char*>(buffer), sizeof(buffer));
+        if (!f) throw std::runtime_error("Truncated hash index: " + path);
+
+        uint64_t packed;
+        if (!packKey(key, packed)) { skipped++; continue; }
+        const char* bytes = reinterpret_cast<const char*>(buffer);
+        if (const FlatHashIndex::Slot* dup = table.find(packed)) { // last one wins, keep the values block dense
+            std::copy(bytes, bytes + entry_bytes, owned_values.begin() + dup->value * entry_bytes);
+            continue;
+        }
+        table.insert(packed, owned_values.size() / entry_bytes);
+        owned_values.insert(owned_values.end(), bytes, bytes + entry_bytes);
+    }
+    values = owned_values.data();
+    if (skipped > 0) std::cerr << "Warning: skipped " << skipped << " hash index entries with unknown zones or malformed keys\n";
+
+    // runtime zone index -> zone index of its id in the keys (the converter has no runtime zones)
+    zone_remap.resize(runtime_zones.size());
+    for (uint32_t i = 0; i < zone_remap.size(); i++) zone_remap[i] = zone_lookup.at(runtime_zones[i]);
+    std::cout << "Loaded the " << table.size() << " entries!\n";
+}
+
+void HashIndex::loadV2(const std::string& path) {
+    file = MappedFile(path);
+    const char* base = file.data();
+    size_t size = file.size();
+
+    // the v2 header is the v3 header without the aggregate layout fields
+    const size_t v2_header_size = offsetof(HashIndexHeader, aggregate_field);
+    if (size < v2_header_size) throw std::runtime_error("Truncated hash index: " + path);
+    HashIndexHeader header{};
+    memcpy(&header, base, v2_header_size);
+    if (header.version == VERSION) {
+        if (size < sizeof(HashIndexHeader)) throw std::runtime_error("Truncated hash index: " + path);
+        memcpy(&header, base, sizeof(header));
+    } else if (header.version == 2) {
+        header.aggregate_field = ALL_FIELDS;
+        header.precision = F64;
+    } else {
+        throw std::runtime_error("Unsupported hash index version " + std::to_string(header.version) + ": " + path);
+    }
+    if (header.time_zoning_type != static_cast<uint32_t>(time_zoning_type))
+        throw std::runtime_error("Hash index was built for time zoning type " + std::to_string(header.time_zoning_type) + ": " + path);
+    if (header.aggregate_field > PERCENTILES || header.precision > U16_SECONDS ||
+        header.values_per_entry != fieldCount(static_cast<AggregateField>(header.aggregate_field)) ||
+        header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 || header.num_entries >= header.capacity ||
+        header.slots_offset % 8 != 0 || header.values_offset % 8 != 0 ||
+        header.slots_offset + header.capacity * sizeof(FlatHashIndex::Slot) > size ||
+        header.values_offset + header.num_entries * header.values_per_entry *
+            precisionBytes(static_cast<AggregatePrecision>(header.precision)) > size)
+        throw std::runtime_error("Corrupt hash index header: " + path);
+    stored_field = static_cast<AggregateField>(header.aggregate_field);
+    precision = static_cast<AggregatePrecision>(header.precision);
+    entry_bytes = header.values_per_entry * precisionBytes(precision);
+
+    // zone ids of the keys, only these (small) strings are copied out of the mapping
+    zone_names.clear();
+    zone_lookup.clear();
+    size_t pos = header.zones_offset;
+    for (uint32_t i = 0; i < header.num_zones; i++) {
+        uint32_t len;
+        if (pos + 4 > size) throw std::runtime_error("Corrupt hash index zones: " + path);
+        memcpy(&len, base + pos, 4);
+        if (pos + 4 + len > size) throw std::runtime_error("Corrupt hash index zones: " + path);
+        zone_names.emplace_back(base + pos + 4, len);
+        zone_lookup.emplace(zone_names.back(), i);
+        pos += 4 + len;
+    }
+
+    // every probe must reach an empty slot and every slot must point into the values block
+    const FlatHashIndex::Slot* slots = reinterpret_cast<const FlatHashIndex::Slot*>(base + header.slots_offset);
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < header.capacity; i++) {
+        if (slots[i].key == HashKey::EMPTY) continue;
+        if (slots[i].value >= header.num_entries) throw std::runtime_error("Corrupt hash index slots: " + path);
+        used++;
+    }
+    if (used != header.num_entries) throw std::runtime_error("Corrupt hash index slots: " + path);
+    table.attach(slots, header.capacity, header.num_entries);
+    values = base + header.values_offset;
+
+    // runtime zone index -> zone index of the keys
+    zone_remap.assign(runtime_zones.size(), NO_ZONE);
+    for (uint32_t i = 0; i < runtime_zones.size(); i++) {
+        auto it = zone_lookup.find(runtime_zones[i]);
+        if (it != zone_lookup.end()) zone_remap[i] = it->second;
+    }
+    std::cout << "Mapped the hash table index with " << table.size() << " entries!\n";
+}
+
+void HashIndex::save(const std::string& path) const {
+    auto align8 = [](uint64_t offset) { return (offset + 7) & ~uint64_t(7); };
+
+    HashIndexHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.time_zoning_type = static_cast<uint32_t>(time_zoning_type);
+    header.num_entries = table.size();
+    header.capacity = table.capacity();
+    header.num_zones = static_cast<uint32_t>(zone_names.size());
+    header.values_per_entry = static_cast<uint32_t>(fieldCount(stored_field));
+    header.aggregate_field = stored_field;
+    header.precision = precision;
+    header.zones_offset = align8(sizeof(HashIndexHeader));
+    uint64_t zones_size = 0;
+    for (const auto& name : zone_names) zones_size += 4 + name.size();
+    header.slots_offset = align8(header.zones_offset + zones_size);
+    header.values_offset = align8(header.slots_offset + header.capacity * sizeof(FlatHashIndex::Slot));
+
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) throw std::runtime_error("Cannot create hash index: " + path);
+    auto pad = [&f](uint64_t offset) { // zero fill up to offset
+        static const char zeros[8] = {};
+        uint64_t at = static_cast<uint64_t>(f.tellp());
+        if (offset > at) f.write(zeros, offset - at);
+    };
+
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(header.zones_offset);
+    for (const auto& name : zone_names) {
+        uint32_t len = static_cast<uint32_t>(name.size());
+        f.write(reinterpret_cast<const char*>(&len), 4);
+        f.write(name.data(), len);
+    }
+    pad(header.slots_offset);
+    f.write(reinterpret_cast<const char*>(table.data()), header.capacity * sizeof(FlatHashIndex::Slot));
+    pad(header.values_offset);
+    f.write(values, header.num_entries * entry_bytes);
+    if (!f) throw std::runtime_error("Failed writing hash index: " + path);
+}
+
+void HashIndex::compact(AggregateField field, AggregatePrecision new_precision) {
+    if (isMapped())
+        throw std::runtime_error("Cannot compact a mapped hash index, convert it with the aggregate type and precision instead");
+    if (stored_field != ALL_FIELDS || precision != F64)
+        throw std::runtime_error("Hash index is already compacted");
+
+    size_t offset = fieldOffset(field);
+    size_t count = fieldCount(field);
+    size_t new_entry_bytes = count * precisionBytes(new_precision);
+    size_t num_entries = owned_values.size() / entry_bytes;
+    std::vector<char> compacted(num_entries * new_entry_bytes);
+    uint64_t clamped = 0; // u16 values outside [0, 65535] s
+
+    for (size_t i = 0; i < num_entries; i++) {
+        double full[VALUES_PER_ENTRY];
+        memcpy(full, owned_values.data() + i * entry_bytes, sizeof(full));
+        char* out = compacted.data() + i * new_entry_bytes;
+        for (size_t j = 0; j < count; j++) {
+            double v = full[offset + j];
+            switch (new_precision) {
+                case F64:
+                    memcpy(out + j * sizeof(double), &v, sizeof(double));
+                    break;
+                case F32: {
+                    float f = static_cast<float>(v);
+                    memcpy(out + j * sizeof(float), &f, sizeof(float));
+                    break;
+                }
+                case U16_SECONDS: {
+                    double r = std::round(v);
+                    if (r < 0 || r > 65535) { clamped++; r = std::min(std::max(r, 0.0), 65535.0); }
+                    uint16_t u = static_cast<uint16_t>(r);
+                    memcpy(out + j * sizeof(uint16_t), &u, sizeof(uint16_t));
+                    break;
+                }
+            }
+        }
+    }
+    if (clamped > 0) std::cerr << "Warning: clamped " << clamped << " aggregate values outside [0, 65535] seconds\n";
+
+    owned_values.swap(compacted);
+    values = owned_values.data();
+    stored_field = field;
+    precision = new_precision;
+    entry_bytes = new_entry_bytes;
+}
+
+AggregateField HashIndex::parseAggregateField(const std::string& name) {
+    if      (name == "all")         return ALL_FIELDS;
+    else if (name == "min_max")     return MIN_MAX;
+    else if (name == "min_med_max") return MIN_MED_MAX;
+    else if (name == "percentiles") return PERCENTILES;
+    throw std::invalid_argument("Unknown aggregate type: " + name +
+                                "\nShould be either \"all\" or \"percentiles\" or \"min_med_max\" or \"min_max\"\n");
+}
+
+AggregatePrecision HashIndex::parseAggregatePrecision(const std::string& name) {
+    if      (name == "f64") return F64;
+    else if (name == "f32") return F32;
+    else if (name == "u16") return U16_SECONDS;
+    throw std::invalid_argument("Unknown aggregate precision: " + name +
+                                "\nShould be either \"f64\" or \"f32\" or \"u16\"\n");
+}
+
+bool HashIndex::packKey(const std::string& key, uint64_t& packed) {
+    // split the key on ','
+    std::string parts[6];
+    size_t num_parts = 0, start = 0;
+    while (true) {
+        size_t comma = key.find(',', start);
+        if (num_parts == 6) return false;
+        parts[num_parts++] = key.substr(start, comma - start);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    bool range = (time_zoning_type == TimeZoningType::DOW_RANGE || time_zoning_type == TimeZoningType::DAYTYPE_RANGE);
+    if (num_parts != (range ? 6u : 5u)) return false;
+
+    // the whole field must be the integer, e.g. "3h" or "1.5" are malformed
+    auto parseInt = [](const std::string& field, int& value) {
+        auto parsed = std::from_chars(field.data(), field.data() + field.size(), value);
+        return parsed.ec == std::errc() && parsed.ptr == field.data() + field.size();
+    };
+    int season, day, hour1, hour2 = 0;
+    if (time_zoning_type == TimeZoningType::DAYTYPE_HOD || time_zoning_type == TimeZoningType::DAYTYPE_RANGE) {
+        if      (parts[3] == "weekday") day = 0;
+        else if (parts[3] == "weekend") day = 1;
+        else return false;
+    } else if (!parseInt(parts[3], day)) {
+        return false;
+    }
+    if (!parseInt(parts[2], season) || !parseInt(parts[4], hour1) || (range && !parseInt(parts[5], hour2)))
+        return false;
+    uint64_t time_bits;
+    try {
+        time_bits = HashKey::timeBits(season, day, hour1, hour2);
+    } catch (const std::out_of_range&) {
+        return false;
+    }
+
+    // dense zone indices of the key zones
+    uint32_t zones[2];
+    for (int z = 0; z < 2; z++) {
+        auto it = zone_lookup.find(parts[z]);
+        if (it != zone_lookup.end()) {
+            zones[z] = it->second;
+        } else if (intern_zones && zone_names.size() < HashKey::MAX_ZONES) {
+            zones[z] = static_cast<uint32_t>(zone_names.size());
+            zone_lookup.emplace(parts[z], zones[z]);
+            zone_names.push_back(parts[z]);
+        } else {
+            return false;
+        }
+    }
+    packed = HashKey::pack(zones[0], zones[1], time_bits); // the dense zone indices are below MAX_ZONES
+    return true;
+}
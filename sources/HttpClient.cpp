@@ -0,0 +1,328 @@
+#include "../headers/HttpClient.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <strings.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+HttpClient::HttpClient(const std::string& host, int port, size_t pool_size)
+    : host(host), port(port), pool_size(pool_size ? pool_size : 1) {}
+
+HttpClient::~HttpClient() {
+    for (int sock : idle) close(sock);
+}
+
+void HttpClient::resolve() {
+    // getaddrinfo is thread-safe, unlike gethostbyname, and resolved only once for all connections
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res)
+        throw std::runtime_error("Cannot resolve host: " + host);
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+}
+
+void HttpClient::setTimeouts(int connect_timeout, int read_timeout) {
+    connect_timeout_ms = std::max(connect_timeout, 0);
+    read_timeout_ms = std::max(read_timeout, 0);
+}
+
+int HttpClient::pollTimeout(HttpDeadline deadline, int timeout_ms) {
+    if (deadline == HttpDeadline::max() && timeout_ms <= 0) return -1;
+    auto now = std::chrono::steady_clock::now();
+    if (timeout_ms > 0) deadline = std::min(deadline, now + std::chrono::milliseconds(timeout_ms));
+    if (deadline <= now) return 0;
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1; // round up
+    return static_cast<int>(std::min<long long>(left, 1 << 30));
+}
+
+int HttpClient::connectSocket(HttpDeadline deadline) {
+    int sock = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (sock < 0) throw std::runtime_error("Socket creation failed");
+    int wait = pollTimeout(deadline, connect_timeout_ms);
+    if (wait < 0) {
+        if (connect(sock, reinterpret_cast<const sockaddr*>(&addr), addr_len) < 0) {
+            close(sock);
+            throw std::runtime_error("Connection failed to " + host);
+        }
+    } else {
+        // non-blocking connect bounded by the connect timeout and the deadline, then back to blocking
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+        if (connect(sock, reinterpret_cast<const sockaddr*>(&addr), addr_len) < 0) {
+            if (errno != EINPROGRESS) {
+                close(sock);
+                throw std::runtime_error("Connection failed to " + host);
+            }
+            pollfd p{sock, POLLOUT, 0};
+            int ready;
+            do { ready = poll(&p, 1, wait); } while (ready < 0 && errno == EINTR);
+            if (ready == 0) {
+                close(sock);
+                throw HttpTimeout("Connect timed out to " + host);
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (ready < 0 || err != 0) {
+                close(sock);
+                throw std::runtime_error("Connection failed to " + host);
+            }
+        }
+        fcntl(sock, F_SETFL, flags);
+    }
+    int one = 1; // the request is written at once, do not wait for acks of the previous segment
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    opened++;
+    return sock;
+}
+
+int HttpClient::acquire(bool& reused, HttpDeadline deadline) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto ready = [this] { return !idle.empty() || open_count < pool_size; };
+        if (deadline == HttpDeadline::max()) available.wait(lock, ready);
+        else if (!available.wait_until(lock, deadline, ready))
+            throw HttpTimeout("Deadline exceeded waiting for a connection to " + host);
+        if (!idle.empty()) {
+            int sock = idle.back(); // the most recently used connection is the least likely to be stale
+            idle.pop_back();
+            reused = true;
+            return sock;
+        }
+        open_count++;
+    }
+    reused = false;
+    try {
+        return connectSocket(deadline); // connect outside the lock
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        open_count--;
+        available.notify_one();
+        throw;
+    }
+}
+
+void HttpClient::release(int sock, bool keep) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (keep) {
+        idle.push_back(sock);
+    } else {
+        close(sock);
+        open_count--;
+    }
+    available.notify_one();
+}
+
+std::string HttpClient::buildRequest(const std::string& host, const std::string& method,
+                                     const std::string& path, const std::string& body) {
+    std::string request = method + " " + path + " HTTP/1.1\r\n"
+                          "Host: " + host + "\r\n";
+    if (method == "POST")
+        request += "Content-Type: application/json\r\n"
+                   "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    else
+        request += "\r\n";
+    return request;
+}
+
+std::string HttpClient::request(const std::string& method, const std::string& path, const std::string& body,
+                                HttpDeadline deadline, const BodyCheck& enough) {
+    std::call_once(resolved, &HttpClient::resolve, this);
+
+    std::string request = buildRequest(host, method, path, body);
+
+    for (;;) {
+        bool reused;
+        int sock = acquire(reused, deadline);
+        std::string response;
+        bool keep_alive = false;
+        bool answered;
+        try {
+            answered = exchange(sock, request, response, keep_alive, deadline, enough);
+        } catch (...) {
+            release(sock, false);
+            throw;
+        }
+        if (answered) {
+            release(sock, keep_alive);
+            return response;
+        }
+        release(sock, false);
+        // the server closed an idle keep-alive connection (dropped now), retry until a fresh connection fails
+        if (!reused) throw std::runtime_error("Connection closed by " + host);
+    }
+}
+
+// case-insensitive value of header name in the header block (lower case name with ':'), or npos
+static size_t headerValue(const std::string& headers, const char* name) {
+    size_t len = strlen(name);
+    for (size_t line = headers.find("\r\n"); line != std::string::npos; line = headers.find("\r\n", line + 2)) {
+        if (strncasecmp(headers.c_str() + line + 2, name, len) == 0) {
+            size_t v = line + 2 + len;
+            while (v < headers.size() && (headers[v] == ' ' || headers[v] == '\t')) v++;
+            return v;
+        }
+    }
+    return std::string::npos;
+}
+
+static bool headerHasToken(const std::string& headers, const char* name, const char* token) {
+    size_t v = headerValue(headers, name);
+    if (v == std::string::npos) return false;
+    size_t end = headers.find("\r\n", v);
+    std::string value = headers.substr(v, end - v);
+    for (auto& c : value) c = tolower(c);
+    return value.find(token) != std::string::npos;
+}
+
+bool HttpResponseParser::parse(std::string& buffer, HttpResponse& response, bool eof) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) return false;
+    std::string headers = buffer.substr(0, header_end + 2); // status line and headers, each ending with \r\n
+    size_t pos = header_end + 4;
+
+    // HTTP/1.1 keeps the connection unless told otherwise, HTTP/1.0 closes it unless told otherwise
+    if (headers.compare(0, 8, "HTTP/1.0") == 0)
+        response.keep_alive = headerHasToken(headers, "connection:", "keep-alive");
+    else
+        response.keep_alive = !headerHasToken(headers, "connection:", "close");
+
+    response.status = (headers.size() > 12) ? atoi(headers.c_str() + 9) : 0;
+    bool no_body = (response.status >= 100 && response.status < 200) || response.status == 204 || response.status == 304;
+
+    if (headerHasToken(headers, "transfer-encoding:", "chunked")) {
+        // chunks of { hex size \r\n data \r\n } up to the 0 size chunk and the optional trailers
+        std::string body;
+        for (;;) {
+            size_t line_end = buffer.find("\r\n", pos);
+            if (line_end == std::string::npos) return false;
+            size_t chunk = strtoull(buffer.c_str() + pos, nullptr, 16);
+            pos = line_end + 2;
+            if (chunk == 0) {
+                size_t trailers_end = buffer.find("\r\n\r\n", pos - 2);
+                if (trailers_end == std::string::npos) return false;
+                pos = trailers_end + 4;
+                break;
+            }
+            if (buffer.size() < pos + chunk + 2) return false;
+            body.append(buffer, pos, chunk);
+            pos += chunk + 2;
+        }
+        response.body = std::move(body);
+    } else if (no_body) {
+        response.body.clear();
+    } else {
+        size_t length_at = headerValue(headers, "content-length:");
+        if (length_at != std::string::npos) {
+            size_t length = strtoull(headers.c_str() + length_at, nullptr, 10);
+            if (buffer.size() < pos + length) return false;
+            if (buffer.size() == pos + length) { // nothing pipelined behind it, hand the buffer over as the body
+                buffer.erase(0, pos);
+                response.body.swap(buffer);
+                buffer.clear();
+                return true;
+            }
+            response.body = buffer.substr(pos, length);
+            pos += length;
+        } else {
+            // no framing, the body ends with the connection
+            if (!eof) return false;
+            buffer.erase(0, pos);
+            response.body.swap(buffer);
+            buffer.clear();
+            response.keep_alive = false;
+            return true;
+        }
+    }
+    buffer.erase(0, pos);
+    return true;
+}
+
+bool HttpResponseParser::partialBody(const std::string& buffer, std::string_view& body, size_t& missing) {
+    size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) return false;
+    std::string headers = buffer.substr(0, header_end + 2);
+    if (headerHasToken(headers, "transfer-encoding:", "chunked")) return false;
+    size_t length_at = headerValue(headers, "content-length:");
+    if (length_at == std::string::npos) return false;
+    size_t length = strtoull(headers.c_str() + length_at, nullptr, 10);
+    size_t pos = header_end + 4;
+    size_t received = std::min(length, buffer.size() - pos);
+    body = std::string_view(buffer).substr(pos, received);
+    missing = length - received;
+    return true;
+}
+
+void HttpClient::quickAck(int sock) {
+#ifdef TCP_QUICKACK
+    // ack at once: servers writing the headers and the body separately would otherwise stall on
+    // Nagle until the delayed ack (~40 ms) on a kept-alive connection (re-armed as the kernel clears it)
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+#endif
+}
+
+bool HttpClient::exchange(int sock, const std::string& request, std::string& body, bool& keep_alive,
+                          HttpDeadline deadline, const BodyCheck& enough) {
+    // Send Request (MSG_NOSIGNAL: a closed connection is an error, not a SIGPIPE)
+    for (size_t sent = 0; sent < request.size();) {
+        ssize_t n = send(sock, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (sent == 0 && (errno == EPIPE || errno == ECONNRESET)) return false;
+            throw std::runtime_error("Send failed");
+        }
+        sent += n;
+    }
+
+    // Receive response until its framing says it is complete
+    std::string buffer;
+    char buf[16384];
+    HttpResponse response;
+    bool eof = false;
+    size_t next_check = sizeof(buf); // received bytes of the next early stop check
+    while (!HttpResponseParser::parse(buffer, response, eof)) {
+        if (enough && buffer.size() >= next_check) {
+            next_check = buffer.size() * 2;
+            std::string_view received;
+            size_t missing;
+            if (HttpResponseParser::partialBody(buffer, received, missing) && missing >= EARLY_STOP_MIN_BYTES && enough(received)) {
+                body.assign(received);
+                keep_alive = false; // the rest of the body is still on the way, close the connection
+                return true;
+            }
+        }
+        if (eof) {
+            if (buffer.empty()) return false; // stale connection
+            throw std::runtime_error("Truncated HTTP response");
+        }
+        int wait = pollTimeout(deadline, read_timeout_ms);
+        if (wait >= 0) {
+            pollfd p{sock, POLLIN, 0};
+            int ready;
+            do { ready = poll(&p, 1, wait); } while (ready < 0 && errno == EINTR);
+            if (ready == 0) throw HttpTimeout("Read timed out from " + host);
+        }
+        quickAck(sock);
+        ssize_t n;
+        do { n = recv(sock, buf, sizeof(buf), 0); } while (n < 0 && errno == EINTR);
+        if (n < 0 && buffer.empty() && errno == ECONNRESET) n = 0; // reset before answering, same as closed
+        if (n < 0) throw std::runtime_error("Receive failed");
+        if (n == 0) eof = true;
+        else buffer.append(buf, n);
+    }
+    body = std::move(response.body);
+    keep_alive = response.keep_alive && !eof;
+    return true;
+}
@@ -0,0 +1,139 @@
+#include "../headers/JsonExtract.hpp"
+#include <charconv>
+#include <cstring>
+
+
+// move offset past the string starting at json[offset] ('"')
+static JsonExtract::Status skipString(std::string_view json, size_t& offset) {
+    // memchr to the next quote (long strings such as encoded geometries), escaped by an odd number of backslashes
+    for (size_t pos = offset + 1; pos < json.size();) {
+        const char* quote = static_cast<const char*>(memchr(json.data() + pos, '"', json.size() - pos));
+        if (!quote) break;
+        size_t at = quote - json.data();
+        size_t backslashes = 0;
+        while (at - backslashes > offset + 1 && json[at - backslashes - 1] == '\\') backslashes++;
+        if (backslashes % 2 == 0) {
+            offset = at + 1;
+            return JsonExtract::FOUND;
+        }
+        pos = at + 1;
+    }
+    return JsonExtract::INCOMPLETE;
+}
+
+JsonExtract::Status JsonExtract::skipValue(std::string_view json, size_t& offset) {
+    skipSpace(json, offset);
+    if (offset >= json.size()) return INCOMPLETE;
+    char c = json[offset];
+    if (c == '"') return skipString(json, offset);
+    if (c == '{' || c == '[') {
+        // nested objects and arrays only matter for their depth (strings may hold brackets)
+        int depth = 0;
+        for (size_t pos = offset; pos < json.size(); pos++) {
+            c = json[pos];
+            if (c == '"') {
+                if (skipString(json, pos) != FOUND) return INCOMPLETE;
+                pos--; // past the closing quote on the next iteration
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    offset = pos + 1;
+                    return FOUND;
+                }
+            }
+        }
+        return INCOMPLETE;
+    }
+    // number, true, false or null: up to the next separator
+    for (size_t pos = offset; pos < json.size(); pos++) {
+        c = json[pos];
+        if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            if (pos == offset) return MALFORMED;
+            offset = pos;
+            return FOUND;
+        }
+    }
+    return INCOMPLETE; // the scalar may go on in the next bytes
+}
+
+JsonExtract::Status JsonExtract::locate(std::string_view json, std::string_view path, size_t& offset) {
+    size_t pos = 0;
+    while (!path.empty()) {
+        size_t slash = path.find('/');
+        std::string_view segment = path.substr(0, slash);
+        path = (slash == std::string_view::npos) ? std::string_view() : path.substr(slash + 1);
+
+        skipSpace(json, pos);
+        if (pos >= json.size()) return INCOMPLETE;
+        if (json[pos] == '{') {
+            // members up to the key of the segment
+            pos++;
+            for (;;) {
+                skipSpace(json, pos);
+                if (pos >= json.size()) return INCOMPLETE;
+                if (json[pos] == '}') return NOT_FOUND;
+                if (json[pos] == ',') { pos++; continue; }
+                if (json[pos] != '"') return MALFORMED;
+                size_t key_start = pos + 1;
+                if (skipString(json, pos) != FOUND) return INCOMPLETE;
+                std::string_view key = json.substr(key_start, pos - 1 - key_start);
+                skipSpace(json, pos);
+                if (pos >= json.size()) return INCOMPLETE;
+                if (json[pos] != ':') return MALFORMED;
+                pos++;
+                if (key == segment) break; // the value follows
+                Status s = skipValue(json, pos);
+                if (s != FOUND) return s;
+            }
+        } else if (json[pos] == '[') {
+            // elements up to the index of the segment
+            size_t index = 0;
+            auto parsed = std::from_chars(segment.data(), segment.data() + segment.size(), index);
+            if (parsed.ec != std::errc() || parsed.ptr != segment.data() + segment.size()) return NOT_FOUND;
+            pos++;
+            for (size_t i = 0;; i++) {
+                skipSpace(json, pos);
+                if (pos >= json.size()) return INCOMPLETE;
+                if (json[pos] == ']') return NOT_FOUND;
+                if (i == index) break;
+                Status s = skipValue(json, pos);
+                if (s != FOUND) return s;
+                skipSpace(json, pos);
+                if (pos >= json.size()) return INCOMPLETE;
+                if (json[pos] == ',') pos++;
+            }
+        } else {
+            return NOT_FOUND; // a scalar where the path goes on
+        }
+    }
+    skipSpace(json, pos);
+    if (pos >= json.size()) return INCOMPLETE;
+    offset = pos;
+    return FOUND;
+}
+
+JsonExtract::Status JsonExtract::parseNumber(std::string_view json, size_t& offset, double& value) {
+    skipSpace(json, offset);
+    if (offset >= json.size()) return INCOMPLETE;
+    const char* begin = json.data() + offset;
+    const char* end = json.data() + json.size();
+    auto parsed = std::from_chars(begin, end, value);
+    if (parsed.ec == std::errc::invalid_argument) {
+        if (json[offset] == '-' || (json[offset] >= '0' && json[offset] <= '9')) return INCOMPLETE; // a lone '-'
+        size_t scalar = offset;
+        Status s = skipValue(json, scalar); // null, a string, an object, ...
+        return s == INCOMPLETE ? INCOMPLETE : NOT_FOUND;
+    }
+    if (parsed.ptr == end) return INCOMPLETE; // more digits may follow
+    if (parsed.ec != std::errc()) return MALFORMED; // out of range
+    offset = parsed.ptr - json.data();
+    return FOUND;
+}
+
+JsonExtract::Status JsonExtract::number(std::string_view json, std::string_view path, double& value) {
+    size_t offset;
+    Status s = locate(json, path, offset);
+    if (s != FOUND) return s;
+    return parseNumber(json, offset, value);
+}
@@ -0,0 +1,62 @@
+#include "../headers/MappedFile.hpp"
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open file: " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat file: " + path);
+    }
+    length = static_cast<size_t>(st.st_size);
+
+    if (length > 0) { // mmap of 0 bytes fails, an empty file is just an empty mapping
+        void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot mmap file: " + path);
+        }
+        addr = p;
+    }
+    close(fd); // the mapping keeps the file referenced
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : addr(other.addr), length(other.length) {
+    other.addr = nullptr;
+    other.length = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        addr = other.addr;     other.addr = nullptr;
+        length = other.length; other.length = 0;
+    }
+    return *this;
+}
+
+void MappedFile::advise(int advice, size_t offset, size_t len) const {
+    if (!addr || offset >= length) return;
+    // madvise needs a page aligned start
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = offset & ~(page - 1);
+    size_t end = (len > length - offset) ? length : offset + len;
+    madvise(static_cast<char*>(addr) + start, end - start, advice);
+}
+
+void MappedFile::unmap() {
+    if (addr) munmap(addr, length);
+    addr = nullptr;
+    length = 0;
+}
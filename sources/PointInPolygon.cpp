@@ -0,0 +1,96 @@
+#include "../headers/PointInPolygon.hpp"
+#include <immintrin.h>
+#include <stdexcept>
+
+void EdgeArrays::add(double xi, double yi, double xj, double yj) {
+    this->xi.push_back(xi);
+    this->yi.push_back(yi);
+    this->yj.push_back(yj);
+    dx.push_back(xj - xi);
+    dy.push_back(yj - yi);
+}
+
+void EdgeArrays::clear() {
+    xi.clear(); yi.clear(); yj.clear(); dx.clear(); dy.clear();
+}
+
+static bool crossScalar(const EdgeArrays& e, size_t begin, size_t end, double lon, double lat) {
+    bool inside = false;
+    for (size_t k = begin; k < end; k++) {
+        if (((e.yi[k] > lat) != (e.yj[k] > lat)) &&
+            (lon < e.dx[k] * (lat - e.yi[k]) / e.dy[k] + e.xi[k])) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// the same operations lane by lane (IEEE sub, mul, div and add give the scalar results), the edges that do not
+// straddle the latitude (horizontal ones divide by 0) are masked out
+__attribute__((target("avx2")))
+static bool crossAvx2(const EdgeArrays& e, size_t begin, size_t end, double lon, double lat) {
+    const __m256d x = _mm256_set1_pd(lon), y = _mm256_set1_pd(lat);
+    unsigned parity = 0;
+    size_t k = begin;
+    for (; k + 4 <= end; k += 4) {
+        __m256d yi = _mm256_loadu_pd(&e.yi[k]);
+        __m256d straddle = _mm256_xor_pd(_mm256_cmp_pd(yi, y, _CMP_GT_OQ),
+                                         _mm256_cmp_pd(_mm256_loadu_pd(&e.yj[k]), y, _CMP_GT_OQ));
+        __m256d cross = _mm256_add_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_loadu_pd(&e.dx[k]), _mm256_sub_pd(y, yi)),
+                                                    _mm256_loadu_pd(&e.dy[k])),
+                                      _mm256_loadu_pd(&e.xi[k]));
+        parity += __builtin_popcount(_mm256_movemask_pd(_mm256_and_pd(straddle, _mm256_cmp_pd(x, cross, _CMP_LT_OQ))));
+    }
+    return (parity & 1) != crossScalar(e, k, end, lon, lat);
+}
+
+__attribute__((target("avx512f")))
+static bool crossAvx512(const EdgeArrays& e, size_t begin, size_t end, double lon, double lat) {
+    const __m512d x = _mm512_set1_pd(lon), y = _mm512_set1_pd(lat);
+    unsigned parity = 0;
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8) {
+        __m512d yi = _mm512_loadu_pd(&e.yi[k]);
+        __mmask8 straddle = _mm512_cmp_pd_mask(yi, y, _CMP_GT_OQ) ^ _mm512_cmp_pd_mask(_mm512_loadu_pd(&e.yj[k]), y, _CMP_GT_OQ);
+        __m512d cross = _mm512_add_pd(_mm512_div_pd(_mm512_mul_pd(_mm512_loadu_pd(&e.dx[k]), _mm512_sub_pd(y, yi)),
+                                                    _mm512_loadu_pd(&e.dy[k])),
+                                      _mm512_loadu_pd(&e.xi[k]));
+        parity += __builtin_popcount(_mm512_mask_cmp_pd_mask(straddle, x, cross, _CMP_LT_OQ));
+    }
+    return (parity & 1) != crossAvx2(e, k, end, lon, lat); // the last 1-7 edges
+}
+
+static bool supported(const std::string& name) {
+    __builtin_cpu_init(); // needed before main (the default kernel is picked during the static initialization)
+    if (name == "scalar") return true;
+    if (name == "avx2") return __builtin_cpu_supports("avx2");
+    if (name == "avx512") return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2");
+    return false;
+}
+
+PointInPolygon::Kernel PointInPolygon::kernel = supported("avx512") ? crossAvx512 : supported("avx2") ? crossAvx2 : crossScalar;
+std::string PointInPolygon::kernel_name = supported("avx512") ? "avx512" : supported("avx2") ? "avx2" : "scalar";
+
+void PointInPolygon::select(const std::string& name) {
+    if (name == "auto") {
+        kernel_name = supported("avx512") ? "avx512" : supported("avx2") ? "avx2" : "scalar";
+    } else if (name == "scalar" || name == "avx2" || name == "avx512") {
+        if (!supported(name)) throw std::invalid_argument("The cpu does not support the " + name + " point in polygon kernel");
+        kernel_name = name;
+    } else {
+        throw std::invalid_argument("Unknown point in polygon kernel: " + name +
+                                    "\nShould be either \"auto\", \"scalar\", \"avx2\" or \"avx512\"\n");
+    }
+    kernel = kernel_name == "avx512" ? crossAvx512 : kernel_name == "avx2" ? crossAvx2 : crossScalar;
+}
+
+std::string PointInPolygon::selected() {
+    return kernel_name;
+}
+
+std::vector<std::string> PointInPolygon::available() {
+    std::vector<std::string> names;
+    for (const char* name : {"scalar", "avx2", "avx512"})
+        if (supported(name)) names.push_back(name);
+    return names;
+}
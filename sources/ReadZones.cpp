@@ -1,207 +1,152 @@
 #include "../headers/ReadZones.hpp"
+#include "../headers/MappedFile.hpp"
+#include <charconv>
+#include <cstring>
+#include <sys/mman.h>
 
-std::vector<Zone> WKTParser::parseCSV(const std::string& filename) {
-    std::vector<Zone> zones;
-    std::ifstream file(filename);
-    std::string line;
-    
-    // Skip header
-    std::getline(file, line);
-    
-    int zone_count = 0; 
-    while (std::getline(file, line)) {
-        zone_count++;
-        
-        // Find the comma separating zone_id and geometry
-        size_t comma_pos = line.find(',');
-        if (comma_pos == std::string::npos) {
-            std::cerr << "Warning: No comma in line " << zone_count << "\n";
-            continue;
-        }
-        
-        Zone zone;
-        zone.id = line.substr(0, comma_pos);
-        
-        // Extract WKT
-        std::string wkt = line.substr(comma_pos + 1);
-        wkt = trimQuotes(wkt);
-
-        // Parse WKT
-        if (!parseWKTGeometry(wkt, zone)) {
-            std::cerr << "Warning: Failed to parse WKT for zone " << zone.id << "\n";
-            continue;
-        }
-        
-        // Precompute bbox of the zone
-        computeBBox(zone);        
-        zones.push_back(zone);
-        
-        if (zone_count % 100 == 0) {
-            std::cout << "Finished Loading " << zone_count << " zones...\n";
-        }
-    }    
-    std::cout << "Successfully loaded " << zones.size() << " zones from CSV: " << filename << "\n";
-
-    return zones;
-}    
+std::vector<Zone> WKTParser::parseCSV(const std::string& filename, size_t threads) {
+    MappedFile file;
+    try {
+        file = MappedFile(filename);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return {};
+    }
+    file.advise(MADV_SEQUENTIAL);
 
+    // the lines after the header
+    std::vector<std::string_view> lines;
+    const char* pos = file.data();
+    const char* end = pos + file.size();
+    bool header = true;
+    while (pos < end) {
+        const char* eol = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if (!eol) eol = end;
+        if (!header) lines.emplace_back(pos, eol - pos);
+        header = false;
+        pos = eol + 1;
+    }
 
-std::string WKTParser::trimQuotes(const std::string& str) {
-    if (str.empty()) return str;   
-    size_t start = 0;
-    size_t end = str.length();
-    // Trim leading quotes and spaces
-    while (start < end && (str[start] == '"' || std::isspace(str[start]))) {
-        start++;
+    // parse the lines in blocks over the workers, failed lines keep their warning
+    std::vector<Zone> parsed(lines.size());
+    std::vector<std::string> warnings(lines.size());
+    std::vector<char> ok(lines.size(), 0);
+    const size_t BLOCK = 16; // lines per task
+    size_t blocks = (lines.size() + BLOCK - 1) / BLOCK;
+    auto parseBlock = [&](size_t b) {
+        for (size_t i = b * BLOCK; i < std::min(lines.size(), (b + 1) * BLOCK); i++)
+            ok[i] = parseLine(lines[i], i + 1, parsed[i], warnings[i]);
+    };
+    if (blocks > 1 && threads != 1) {
+        WorkerPool workers(threads);
+        workers.parallelFor(blocks, parseBlock);
+    } else {
+        for (size_t b = 0; b < blocks; b++) parseBlock(b);
     }
-    // Trim trailing quotes and spaces
-    while (end > start && (str[end-1] == '"' || std::isspace(str[end-1]))) {
-        end--;
+
+    std::vector<Zone> zones;
+    zones.reserve(lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (ok[i]) zones.push_back(std::move(parsed[i]));
+        else if (!warnings[i].empty()) std::cerr << warnings[i] << "\n";
     }
-    return str.substr(start, end - start);
+    std::cout << "Successfully loaded " << zones.size() << " zones from CSV: " << filename << "\n";
+
+    return zones;
 }
 
+// cursor over the WKT text of a line
+struct WKTCursor {
+    const char* pos;
+    const char* end;
 
-bool WKTParser::parseWKTGeometry(const std::string& wkt, Zone& zone) {
-    // Convert to uppercase for case-insensitive comparison
-    std::string wkt_upper = wkt;
-    std::transform(wkt_upper.begin(), wkt_upper.end(), 
-                    wkt_upper.begin(), ::toupper);
-    
-    if (wkt_upper.find("MULTIPOLYGON") == 0) {
-        return parseMultiPolygon(wkt, zone);
-    } 
-    else if (wkt_upper.find("POLYGON") == 0) {
-        return parsePolygon(wkt, zone);
+    void skipSpace() {
+        while (pos < end && std::isspace(static_cast<unsigned char>(*pos))) pos++;
     }
-    else {
-        std::cerr << "Unsupported WKT type: " << wkt.substr(0, 50) << "...\n";
+    bool eat(char c) { // skip the spaces then c if it is next
+        skipSpace();
+        if (pos < end && *pos == c) { pos++; return true; }
         return false;
     }
-}
-
-bool WKTParser::parseMultiPolygon(const std::string& wkt, Zone& zone) {
-    // MULTIPOLYGON (((lon lat, lon lat, ...)), ((lon lat, ...)), ...)
-    size_t start = wkt.find("(((");
-    if (start == std::string::npos) {
-        std::cerr << "Invalid MULTIPOLYGON format\n";
-        return false;
-    }
-    
-    size_t end = wkt.rfind(")))");
-    if (end == std::string::npos) {
-        end = wkt.length();
-    } else {
-        end += 3;  // To include the closing )))
-    }
-    
-    std::string polygons_str = wkt.substr(start, end - start);
-    
-    // Parse each polygon
-    size_t pos = 0;
-    while (pos < polygons_str.length()) {
-        // Find next polygon start
-        size_t poly_start = polygons_str.find("((", pos);
-        if (poly_start == std::string::npos) break;
-        
-        // Find polygon end
-        size_t poly_end = findMatchingParen(polygons_str, poly_start + 1);
-        if (poly_end == std::string::npos) break;
-        
-        std::string poly_str = polygons_str.substr(poly_start, poly_end - poly_start + 1);
-        
-        // Parse this polygon
-        Polygon polygon = parseSinglePolygonString(poly_str);
-        if (!polygon.vertices.empty()) {
-            zone.polygons.push_back(polygon);
-        }
-        
-        pos = poly_end + 1;
+    bool number(double& value) {
+        skipSpace();
+        if (pos < end && *pos == '+') pos++; // from_chars takes no plus sign
+        auto result = std::from_chars(pos, end, value);
+        if (result.ec != std::errc()) return false;
+        pos = result.ptr;
+        return true;
     }
-    
-    return !zone.polygons.empty();
-}
+};
+
+bool WKTParser::parseLine(std::string_view line, size_t line_number, Zone& zone, std::string& warning) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (line.find_first_not_of(" \t") == std::string_view::npos) return false; // blank line
 
-bool WKTParser::parsePolygon(const std::string& wkt, Zone& zone) {
-    // POLYGON ((lon lat, lon lat, ...))
-    size_t start = wkt.find("((");
-    if (start == std::string::npos) {
-        std::cerr << "Invalid POLYGON format\n";
+    // Find the comma separating zone_id and geometry
+    size_t comma_pos = line.find(',');
+    if (comma_pos == std::string_view::npos) {
+        warning = "Warning: No comma in line " + std::to_string(line_number);
         return false;
     }
-    
-    size_t end = wkt.rfind("))");
-    if (end == std::string::npos) {
-        end = wkt.length();
+    zone.id = std::string(line.substr(0, comma_pos));
+
+    // WKT without the surrounding quotes and spaces
+    WKTCursor wkt{line.data() + comma_pos + 1, line.data() + line.size()};
+    while (wkt.pos < wkt.end && (*wkt.pos == '"' || std::isspace(static_cast<unsigned char>(*wkt.pos)))) wkt.pos++;
+    while (wkt.end > wkt.pos && (wkt.end[-1] == '"' || std::isspace(static_cast<unsigned char>(wkt.end[-1])))) wkt.end--;
+
+    auto keyword = [&wkt](const char* word) { // case insensitive
+        size_t n = strlen(word);
+        if (static_cast<size_t>(wkt.end - wkt.pos) < n) return false;
+        for (size_t k = 0; k < n; k++)
+            if (std::toupper(static_cast<unsigned char>(wkt.pos[k])) != word[k]) return false;
+        wkt.pos += n;
+        return true;
+    };
+
+    bool parsed;
+    if (keyword("MULTIPOLYGON")) {
+        // MULTIPOLYGON (((lon lat, lon lat, ...)), ((lon lat, ...)), ...)
+        parsed = wkt.eat('(');
+        do {
+            parsed = parsed && parsePolygon(wkt, zone);
+        } while (parsed && wkt.eat(','));
+        parsed = parsed && wkt.eat(')');
+    } else if (keyword("POLYGON")) {
+        // POLYGON ((lon lat, lon lat, ...))
+        parsed = parsePolygon(wkt, zone);
     } else {
-        end += 2;  // Include the closing ))
+        warning = "Unsupported WKT type: " + std::string(wkt.pos, std::min<size_t>(50, wkt.end - wkt.pos)) + "...";
+        return false;
     }
-    
-    std::string poly_str = wkt.substr(start, end - start);
-    
-    Polygon polygon = parseSinglePolygonString(poly_str);
-    if (!polygon.vertices.empty()) {
-        zone.polygons.push_back(polygon);
-        return true;
+    if (!parsed || zone.polygons.empty()) {
+        warning = "Warning: Failed to parse WKT for zone " + zone.id;
+        return false;
     }
-    
-    return false;
-}
-
 
-size_t WKTParser::findMatchingParen(const std::string& str, size_t start_pos) {
-    int depth = 0;
-    for (size_t i = start_pos; i < str.length(); i++) {
-        if (str[i] == '(') depth++;
-        else if (str[i] == ')') {
-            depth--;
-            if (depth == 0) return i;
-        }
-    }
-    return std::string::npos;
+    // Precompute bbox of the zone
+    computeBBox(zone);
+    return true;
 }
 
-
-Polygon WKTParser::parseSinglePolygonString(const std::string& poly_str) {
+bool WKTParser::parsePolygon(WKTCursor& wkt, Zone& zone) {
+    // ((outer ring), (hole), ...): only the outer ring is kept, holes are ignored
+    if (!wkt.eat('(')) return false;
     Polygon polygon;
-    
-    // Find the coordinates part inside the parentheses
-    size_t start = poly_str.find('(');
-    size_t end = poly_str.rfind(')');
-    
-    if (start == std::string::npos || end == std::string::npos || start >= end) {
-        return polygon;
-    }
-    
-    std::string coords_str = poly_str.substr(start + 1, end - start - 1);
-    
-
-    // Parse polygon and if ring ignore holes only find the first ring
-    size_t first_ring_end = coords_str.find(')');
-    if (first_ring_end != std::string::npos) {
-        std::string first_ring = coords_str.substr(0, first_ring_end);
-        
-        // Remove any leading '('
-        if (!first_ring.empty() && first_ring[0] == '(') {
-            first_ring = first_ring.substr(1);
-        }
-        
-        // Parse the points
-        std::stringstream ss(first_ring);
-        std::string point_str;
-        
-        while (std::getline(ss, point_str, ',')) {
-            point_str = trim(point_str);
-            if (point_str.empty()) continue;
-            
-            std::stringstream point_ss(point_str);
+    bool outer = true;
+    do {
+        if (!wkt.eat('(')) return false;
+        do {
             Point p;
-            
-            if (point_ss >> p.lon >> p.lat) {
-                polygon.vertices.push_back(p);
-            }
-        }
-    }
+            if (!wkt.number(p.lon) || !wkt.number(p.lat)) return false;
+            double extra;
+            while (wkt.number(extra)) {} // Z and M values
+            if (outer) polygon.vertices.push_back(p);
+        } while (wkt.eat(','));
+        if (!wkt.eat(')')) return false;
+        outer = false;
+    } while (wkt.eat(','));
+    if (!wkt.eat(')')) return false;
 
     // Ensure polygon is closed (first point == last point)
     if (polygon.vertices.size() >= 3) {
@@ -209,16 +154,8 @@ Polygon WKTParser::parseSinglePolygonString(const std::string& poly_str) {
             polygon.vertices.push_back(polygon.vertices.front());
         }
     }
-    
-    return polygon;
-}
-
-
-std::string WKTParser::trim(const std::string& str) {
-    size_t first = str.find_first_not_of(" \t\n\r");
-    if (first == std::string::npos) return "";
-    size_t last = str.find_last_not_of(" \t\n\r");
-    return str.substr(first, (last - first + 1));
+    if (!polygon.vertices.empty()) zone.polygons.push_back(std::move(polygon));
+    return true;
 }
 
 
@@ -240,58 +177,387 @@ void WKTParser::computeBBox(Zone& zone) {
 }
 
 
-GridIndex::GridIndex(const std::vector<Zone>& z, int cells_per_degree) : zones(z) {
+ZoneStore::ZoneStore(const std::vector<Zone>& zones) : zone_polygons{0} {
+    size_t vertex_count = 0, polygon_count = 0;
+    for (const auto& zone : zones) {
+        polygon_count += zone.polygons.size();
+        for (const auto& poly : zone.polygons) vertex_count += poly.vertices.size();
+    }
+    if (vertex_count > UINT32_MAX || polygon_count > UINT32_MAX || zones.size() >= NO_ZONE)
+        throw std::length_error("Too many zones or vertices for the zone store");
+    zone_ids.reserve(zones.size());
+    zone_bboxes.reserve(zones.size());
+    zone_polygons.reserve(zones.size() + 1);
+    polygons.reserve(polygon_count);
+    vertices.reserve(vertex_count);
+
+    for (const auto& zone : zones) {
+        zone_ids.push_back(zone.id);
+        zone_bboxes.push_back(zone.bbox);
+        for (const auto& poly : zone.polygons) {
+            PolygonRange range{static_cast<uint32_t>(vertices.size()), 0};
+            vertices.insert(vertices.end(), poly.vertices.begin(), poly.vertices.end());
+            range.end = vertices.size();
+            // edge k from vertex k to the previous one, as in the ray casting loop
+            for (uint32_t i = range.begin, j = range.end - 1; i < range.end; j = i++)
+                edges.add(vertices[i].lon, vertices[i].lat, vertices[j].lon, vertices[j].lat);
+            polygons.push_back(range);
+        }
+        zone_polygons.push_back(polygons.size());
+    }
+}
+
+
+int GridIndex::autoResolution(const ZoneStore& zones) {
+    // about 8 cells across the zones of the dense areas (the lower quartile of the zone extents),
+    // so most cells fall inside a single zone even downtown
+    std::vector<double> extents;
+    for (uint32_t z = 0; z < zones.size(); z++) {
+        const BBox& bbox = zones.bbox(z);
+        extents.push_back(std::max(bbox.max_lon - bbox.min_lon, bbox.max_lat - bbox.min_lat));
+    }
+    if (extents.empty()) return 10;
+    std::nth_element(extents.begin(), extents.begin() + extents.size() / 4, extents.end());
+    double quartile = extents[extents.size() / 4];
+    if (quartile <= 0) return 10;
+    return std::max(10, static_cast<int>(std::ceil(8 / quartile)));
+}
+
+GridIndex::GridIndex(std::shared_ptr<const ZoneStore> z, int cells_per_degree) : SpatialIndex(std::move(z)) {
     // Calculate global bounds
     min_lon = 180; max_lon = -180; min_lat = 90; max_lat = -90;
-    for (const auto& zone : zones) {
-        min_lon = std::min(min_lon, zone.bbox.min_lon);
-        max_lon = std::max(max_lon, zone.bbox.max_lon);
-        min_lat = std::min(min_lat, zone.bbox.min_lat);
-        max_lat = std::max(max_lat, zone.bbox.max_lat);
+    for (uint32_t zone = 0; zone < zones->size(); zone++) {
+        const BBox& bbox = zones->bbox(zone);
+        min_lon = std::min(min_lon, bbox.min_lon);
+        max_lon = std::max(max_lon, bbox.max_lon);
+        min_lat = std::min(min_lat, bbox.min_lat);
+        max_lat = std::max(max_lat, bbox.max_lat);
     }
+    if (zones->size() == 0) min_lon = max_lon = min_lat = max_lat = 0;
     
     // Add small padding
     min_lon -= 0.1; max_lon += 0.1;
     min_lat -= 0.1; max_lat += 0.1;
     
-    // Initialize grid
+    // Initialize grid, bounded to MAX_CELLS cells
+    if (cells_per_degree <= 0) cells_per_degree = autoResolution(*zones);
+    double area = (max_lon - min_lon) * (max_lat - min_lat);
+    if (area * cells_per_degree * cells_per_degree > MAX_CELLS)
+        cells_per_degree = std::max(1, static_cast<int>(std::sqrt(MAX_CELLS / area)));
+    this->cells_per_degree = cells_per_degree;
     grid_size_x = static_cast<int>((max_lon - min_lon) * cells_per_degree) + 1;
     grid_size_y = static_cast<int>((max_lat - min_lat) * cells_per_degree) + 1;
     cell_width = (max_lon - min_lon) / grid_size_x;
     cell_height = (max_lat - min_lat) / grid_size_y;
-    
-    grid.resize(grid_size_y, std::vector<Cell>(grid_size_x));
-    
-    // Index zones
-    for (int i = 0; i < zones.size(); i++) {
-        const auto& bbox = zones[i].bbox;
-        
-        int min_x = getGridX(bbox.min_lon);
-        int max_x = getGridX(bbox.max_lon);
-        int min_y = getGridY(bbox.min_lat);
-        int max_y = getGridY(bbox.max_lat);
-        
-        // Add zone to all intersecting cells
-        for (int y = min_y; y <= max_y; y++) {
-            for (int x = min_x; x <= max_x; x++) {
-                grid[y][x].zone_indices.push_back(i);
+
+    classify();
+}
+
+void GridIndex::classify() {
+    // A point of a cell is within CELL_MARGIN of it whatever the rounding of getGridX / getGridY, so over the cell:
+    // - an edge whose latitudes are both below or both above its row (or a horizontal one) never straddles the point's
+    //   latitude, and an edge left of it never crosses the ray: they never count
+    // - an edge right of it crosses the ray whenever it straddles the point's latitude, which is the parity of its
+    //   endpoints above the point: constant for the endpoints above or below the row, a toggle for those within it
+    // - the edges crossing the cell are tested as Polygon::contains does
+    // A polygon without crossing edges nor toggles is thus inside or outside the whole cell
+    const double e = CELL_MARGIN;
+    size_t total = static_cast<size_t>(grid_size_x) * grid_size_y;
+    cells.assign(total, EMPTY);
+
+    std::vector<uint32_t> cover(total, ZoneStore::NO_ZONE); // first zone holding the whole cell
+    std::vector<CellZone> records;                // zones not constant over a cell, in index order per cell
+    std::vector<int> head(total, -1), tail(total, -1), next;
+
+    for (uint32_t z = 0; z < zones->size(); z++) {
+        const BBox& bbox = zones->bbox(z);
+        int x0 = std::max(0, getGridX(bbox.min_lon - e)), x1 = std::min(grid_size_x - 1, getGridX(bbox.max_lon + e));
+        int y0 = std::max(0, getGridY(bbox.min_lat - e)), y1 = std::min(grid_size_y - 1, getGridY(bbox.max_lat + e));
+        if (x0 > x1 || y0 > y1) continue;
+        int cols = x1 - x0 + 1;
+        std::vector<std::vector<CellPolygon>> local(static_cast<size_t>(cols) * (y1 - y0 + 1)); // polygons not outside the cell
+        std::vector<char> inside(local.size(), 0);   // a polygon holds the whole cell
+
+        for (uint32_t k = zones->polygonBegin(z); k < zones->polygonEnd(z); k++) {
+            const ZoneStore::PolygonRange& poly = zones->polygon(k);
+            if (poly.end - poly.begin < 3) continue; // never contains a point
+            for (int y = y0; y <= y1; y++) {
+                double lo = min_lat + y * cell_height - e, hi = min_lat + (y + 1) * cell_height + e;
+                std::vector<Edge> band; // edges that can straddle a latitude of the row
+                for (uint32_t i = poly.begin, j = poly.end - 1; i < poly.end; j = i++) {
+                    const Point& a = zones->vertex(i);
+                    const Point& b = zones->vertex(j);
+                    if (a.lat == b.lat || std::max(a.lat, b.lat) < lo || std::min(a.lat, b.lat) > hi) continue;
+                    band.push_back({a.lon, a.lat, b.lon, b.lat});
+                }
+
+                for (int x = x0; x <= x1; x++) {
+                    size_t cell = static_cast<size_t>(y) * grid_size_x + x;
+                    if (cover[cell] != ZoneStore::NO_ZONE) continue; // an earlier zone holds the whole cell
+                    double left = min_lon + x * cell_width - e, right = min_lon + (x + 1) * cell_width + e;
+                    CellPolygon polygon{static_cast<uint32_t>(edges.size()), 0, static_cast<uint32_t>(toggles.size()), 0, false};
+                    for (const Edge& edge : band) {
+                        if (std::max(edge.xi, edge.xj) < left) continue;
+                        if (std::min(edge.xi, edge.xj) > right) {
+                            for (double end_lat : {edge.yi, edge.yj}) {
+                                if (end_lat > hi) polygon.parity = !polygon.parity;
+                                else if (end_lat >= lo) toggles.push_back(end_lat);
+                            }
+                        } else {
+                            edges.add(edge.xi, edge.yi, edge.xj, edge.yj);
+                        }
+                    }
+                    // a vertex shared by two edges right of the cell toggles twice
+                    std::sort(toggles.begin() + polygon.toggle_begin, toggles.end());
+                    size_t kept = polygon.toggle_begin;
+                    for (size_t t = polygon.toggle_begin; t < toggles.size(); t++) {
+                        if (t + 1 < toggles.size() && toggles[t] == toggles[t + 1]) t++;
+                        else toggles[kept++] = toggles[t];
+                    }
+                    toggles.resize(kept);
+                    polygon.edge_end = edges.size();
+                    polygon.toggle_end = toggles.size();
+
+                    size_t l = static_cast<size_t>(y - y0) * cols + (x - x0);
+                    if (polygon.edge_end > polygon.edge_begin || polygon.toggle_end > polygon.toggle_begin) {
+                        local[l].push_back(polygon);
+                    } else if (polygon.parity) {
+                        local[l].push_back(polygon);
+                        inside[l] = 1;
+                    }
+                }
+            }
+        }
+
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                size_t cell = static_cast<size_t>(y) * grid_size_x + x;
+                size_t l = static_cast<size_t>(y - y0) * cols + (x - x0);
+                if (cover[cell] != ZoneStore::NO_ZONE || local[l].empty()) continue; // outside the zone's polygons
+                bool in_bbox = bbox.min_lon <= min_lon + x * cell_width - e && min_lon + (x + 1) * cell_width + e <= bbox.max_lon &&
+                               bbox.min_lat <= min_lat + y * cell_height - e && min_lat + (y + 1) * cell_height + e <= bbox.max_lat;
+                if (inside[l] && in_bbox) {
+                    cover[cell] = z;
+                    continue;
+                }
+                records.push_back({z, static_cast<uint32_t>(cell_polygons.size()),
+                                   static_cast<uint32_t>(cell_polygons.size() + local[l].size())});
+                cell_polygons.insert(cell_polygons.end(), local[l].begin(), local[l].end());
+                next.push_back(-1);
+                if (tail[cell] >= 0) next[tail[cell]] = records.size() - 1;
+                else head[cell] = records.size() - 1;
+                tail[cell] = records.size() - 1;
             }
         }
     }
+
+    for (size_t cell = 0; cell < total; cell++) {
+        if (head[cell] < 0) {
+            if (cover[cell] != ZoneStore::NO_ZONE) {
+                cells[cell] = COVERED | cover[cell];
+                covered_count++;
+            } else {
+                empty_count++;
+            }
+            continue;
+        }
+        BoundaryCell b{static_cast<uint32_t>(cell_zones.size()), 0, cover[cell]};
+        for (int r = head[cell]; r >= 0; r = next[r]) cell_zones.push_back(records[r]);
+        b.zone_end = cell_zones.size();
+        cells[cell] = BOUNDARY | static_cast<uint32_t>(boundary.size());
+        boundary.push_back(b);
+    }
 }
     
-std::string GridIndex::findZoneContainingPoint(double lon, double lat) {
+const std::string& SpatialIndex::findZoneContainingPoint(double lon, double lat) const {
+    static const std::string none;
+    uint32_t idx = findZoneIndex(lon, lat);
+    if (idx == ZoneStore::NO_ZONE) return none;
+    return zones->id(idx);
+}
+
+// interleave the bits of x and y (16 bits each)
+static uint32_t mortonCode(uint32_t x, uint32_t y) {
+    auto spread = [](uint32_t v) {
+        v &= 0xFFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+void SpatialIndex::findZoneIndices(const double* lon, const double* lat, size_t n, uint32_t* zone_indices,
+                                   WorkerPool* workers) const {
+    const size_t BLOCK = 4096; // points per task
+    if (n > UINT32_MAX) throw std::length_error("Too many points in a zone lookup batch");
+    if (n < BLOCK) { // not worth sorting
+        for (size_t i = 0; i < n; i++) zone_indices[i] = findZoneIndex(lon[i], lat[i]);
+        return;
+    }
+    size_t blocks = (n + BLOCK - 1) / BLOCK;
+    auto run = [&](const std::function<void(size_t)>& block) {
+        if (workers) workers->parallelFor(blocks, block);
+        else for (size_t b = 0; b < blocks; b++) block(b);
+    };
+
+    // Morton codes of the points on a 2^16 x 2^16 grid over their bounds
+    double min_x = 180, max_x = -180, min_y = 90, max_y = -90;
+    for (size_t i = 0; i < n; i++) {
+        if (lon[i] >= -180 && lon[i] <= 180) { min_x = std::min(min_x, lon[i]); max_x = std::max(max_x, lon[i]); }
+        if (lat[i] >= -90 && lat[i] <= 90) { min_y = std::min(min_y, lat[i]); max_y = std::max(max_y, lat[i]); }
+    }
+    double scale_x = max_x > min_x ? 65535 / (max_x - min_x) : 0, scale_y = max_y > min_y ? 65535 / (max_y - min_y) : 0;
+    auto quantize = [](double v, double min, double scale) {
+        double q = (v - min) * scale;
+        return q > 0 ? static_cast<uint32_t>(std::min(q, 65535.0)) : 0u; // NaN and out of range points at the edges
+    };
+    struct Sorted {
+        uint32_t code, index;
+        double lon, lat; // carried along so the lookups read the sorted points in sequence
+    };
+    std::vector<Sorted> points(n), buffer(n);
+    run([&](size_t b) {
+        for (size_t i = b * BLOCK; i < std::min(n, (b + 1) * BLOCK); i++)
+            points[i] = {mortonCode(quantize(lon[i], min_x, scale_x), quantize(lat[i], min_y, scale_y)),
+                         static_cast<uint32_t>(i), lon[i], lat[i]};
+    });
+
+    // LSD radix sort on the code (2 passes of 16 bits)
+    std::vector<size_t> offsets(65537);
+    for (int shift = 0; shift < 32; shift += 16) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (const Sorted& point : points) offsets[((point.code >> shift) & 0xFFFF) + 1]++;
+        for (size_t d = 1; d < offsets.size(); d++) offsets[d] += offsets[d - 1];
+        for (const Sorted& point : points) buffer[offsets[(point.code >> shift) & 0xFFFF]++] = point;
+        points.swap(buffer);
+    }
+
+    run([&](size_t b) {
+        for (size_t k = b * BLOCK; k < std::min(n, (b + 1) * BLOCK); k++)
+            zone_indices[points[k].index] = findZoneIndex(points[k].lon, points[k].lat);
+    });
+}
+
+std::unique_ptr<SpatialIndex> SpatialIndex::create(const std::string& type, std::shared_ptr<const ZoneStore> zones,
+                                                   size_t leaf_size, int cells_per_degree) {
+    if (type == "grid") return std::make_unique<GridIndex>(zones, cells_per_degree);
+    if (type == "quadtree") return std::make_unique<QuadTreeIndex>(zones, leaf_size);
+    throw std::invalid_argument("Unknown spatial index: " + type +
+                                "\nShould be either \"grid\" or \"quadtree\"\n");
+}
+
+uint32_t GridIndex::findZoneIndex(double lon, double lat) const {
+    if (!(lon >= min_lon && lon <= max_lon && lat >= min_lat && lat <= max_lat)) {
+        return ZoneStore::NO_ZONE;  // Point outside grid
+    }
     int x = getGridX(lon);
     int y = getGridY(lat);
-    
-    if (x < 0 || x >= grid_size_x || y < 0 || y >= grid_size_y) {
-        return {};  // Point outside grid
+    if (x >= grid_size_x || y >= grid_size_y) {
+        return ZoneStore::NO_ZONE;
     }
 
-    for (int idx : grid[y][x].zone_indices) {
-        if (zones[idx].containsPoint(Point{lon, lat})) {
-            return zones[idx].id;
+    uint32_t cell = cells[static_cast<size_t>(y) * grid_size_x + x];
+    if ((cell & KIND) == COVERED) return cell & ~KIND;
+    if ((cell & KIND) == EMPTY) return ZoneStore::NO_ZONE;
+
+    // boundary cell: the zones not constant over it, then the zone holding the rest of it
+    const BoundaryCell& b = boundary[cell & ~KIND];
+    Point p{lon, lat};
+    for (uint32_t i = b.zone_begin; i < b.zone_end; i++) {
+        const CellZone& cell_zone = cell_zones[i];
+        if (!zones->bbox(cell_zone.zone).contains(p)) continue;
+        for (uint32_t k = cell_zone.polygon_begin; k < cell_zone.polygon_end; k++) {
+            if (polygonContains(cell_polygons[k], p)) return cell_zone.zone;
         }
     }
-    return {};
+    return b.fallback;
+}
+
+bool GridIndex::polygonContains(const CellPolygon& polygon, const Point& p) const {
+    // Polygon::contains restricted to what can change inside the cell
+    bool inside = polygon.parity;
+    for (uint32_t t = polygon.toggle_begin; t < polygon.toggle_end; t++) {
+        if (toggles[t] > p.lat) inside = !inside;
+    }
+    return inside != PointInPolygon::crossings(edges, polygon.edge_begin, polygon.edge_end, p.lon, p.lat);
+}
+
+size_t GridIndex::candidates(double lon, double lat) const {
+    if (!(lon >= min_lon && lon <= max_lon && lat >= min_lat && lat <= max_lat)) return 0;
+    int x = getGridX(lon);
+    int y = getGridY(lat);
+    if (x >= grid_size_x || y >= grid_size_y) return 0;
+    uint32_t cell = cells[static_cast<size_t>(y) * grid_size_x + x];
+    if ((cell & KIND) != BOUNDARY) return 0;
+    const BoundaryCell& b = boundary[cell & ~KIND];
+    return b.zone_end - b.zone_begin;
+}
+
+QuadTreeIndex::QuadTreeIndex(std::shared_ptr<const ZoneStore> z, size_t leaf_size, int max_depth)
+    : SpatialIndex(std::move(z)), leaf_size(std::max<size_t>(1, leaf_size)), max_depth(max_depth) {
+    std::vector<uint32_t> all(zones->size());
+    for (uint32_t i = 0; i < zones->size(); i++) {
+        all[i] = i;
+        bounds.expand({zones->bbox(i).min_lon, zones->bbox(i).min_lat});
+        bounds.expand({zones->bbox(i).max_lon, zones->bbox(i).max_lat});
+    }
+    nodes.emplace_back();
+    split(0, bounds, std::move(all), 0);
+}
+
+void QuadTreeIndex::split(size_t node, const BBox& box, std::vector<uint32_t> node_zones, int depth) {
+    max_reached = std::max(max_reached, depth);
+    double mid_lon = (box.min_lon + box.max_lon) / 2, mid_lat = (box.min_lat + box.max_lat) / 2;
+    BBox quadrants[4] = {{box.min_lon, mid_lon, box.min_lat, mid_lat}, {mid_lon, box.max_lon, box.min_lat, mid_lat},
+                         {box.min_lon, mid_lon, mid_lat, box.max_lat}, {mid_lon, box.max_lon, mid_lat, box.max_lat}};
+
+    std::vector<uint32_t> children[4];
+    bool helps = false; // some zone misses a quadrant (else every quadrant would list them all again)
+    if (node_zones.size() > leaf_size && depth < max_depth) {
+        for (uint32_t idx : node_zones)
+            for (int q = 0; q < 4; q++) {
+                if (zones->bbox(idx).intersects(quadrants[q])) children[q].push_back(idx); // stays in index order
+                else helps = true;
+            }
+    }
+    if (!helps) { // leaf
+        nodes[node].begin = leaf_zones.size();
+        leaf_zones.insert(leaf_zones.end(), node_zones.begin(), node_zones.end());
+        nodes[node].end = leaf_zones.size();
+        leaf_count++;
+        return;
+    }
+
+    int32_t child = nodes.size();
+    nodes.resize(nodes.size() + 4); // may move the nodes, index them only
+    nodes[node].mid_lon = mid_lon;
+    nodes[node].mid_lat = mid_lat;
+    nodes[node].child = child;
+    for (int q = 0; q < 4; q++) split(child + q, quadrants[q], std::move(children[q]), depth + 1);
+}
+
+const QuadTreeIndex::Node& QuadTreeIndex::leafOf(double lon, double lat) const {
+    const Node* node = &nodes[0];
+    while (node->child >= 0)
+        node = &nodes[node->child + (lon >= node->mid_lon) + 2 * (lat >= node->mid_lat)];
+    return *node;
+}
+
+uint32_t QuadTreeIndex::findZoneIndex(double lon, double lat) const {
+    Point p{lon, lat};
+    if (!bounds.contains(p)) return ZoneStore::NO_ZONE; // Point outside every zone
+    const Node& leaf = leafOf(lon, lat);
+    for (uint32_t i = leaf.begin; i < leaf.end; i++) {
+        if (zones->containsPoint(leaf_zones[i], p)) return leaf_zones[i];
+    }
+    return ZoneStore::NO_ZONE;
+}
+
+size_t QuadTreeIndex::candidates(double lon, double lat) const {
+    if (!bounds.contains(Point{lon, lat})) return 0;
+    const Node& leaf = leafOf(lon, lat);
+    return leaf.end - leaf.begin;
 }
@@ -0,0 +1,264 @@
+#include "../headers/RoutingBackend.hpp"
+#include "../headers/JsonExtract.hpp"
+#include "../headers/HashIndex.hpp"
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+
+// safe conversion from double to string without rounding for the coordinates
+static std::string dbl2str(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", v);
+    return std::string(buf);
+}
+
+// the number at path of the routing engine json answer
+static double numberAt(std::string_view json, std::string_view path) {
+    // walk the path in place and parse the number there, the rest of the answer is not scanned
+    double value;
+    JsonExtract::Status status = JsonExtract::number(json, path, value);
+    if (status != JsonExtract::FOUND)
+        throw std::runtime_error("No number at " + std::string(path) + " in the routing engine answer");
+    return value;
+}
+
+// parse the rows x cols matrix under "key" (nested arrays, row major) of the routing engine json result
+// null entries (no route) are -1, value_key picks the number of object entries (Valhalla's {"time": ...})
+static std::vector<double> parseMatrixJson(std::string_view json, const char* key,
+                                           size_t rows, size_t cols, const char* value_key = nullptr) {
+    size_t pos;
+    if (JsonExtract::locate(json, key, pos) != JsonExtract::FOUND) throw std::runtime_error(std::string("Key not found: ") + key);
+
+    auto expect = [&](char c) {
+        JsonExtract::skipSpace(json, pos);
+        if (pos >= json.size() || json[pos] != c) throw std::runtime_error(std::string("Malformed matrix: ") + key);
+        pos++;
+    };
+    auto separator = [&]() {
+        JsonExtract::skipSpace(json, pos);
+        if (pos < json.size() && json[pos] == ',') pos++;
+    };
+
+    std::vector<double> matrix;
+    matrix.reserve(rows * cols);
+    expect('[');
+    for (size_t r = 0; r < rows; r++) {
+        expect('[');
+        for (size_t c = 0; c < cols; c++) {
+            double value = -1.0; // no route
+            JsonExtract::skipSpace(json, pos);
+            size_t begin = pos;
+            JsonExtract::Status status = (pos < json.size() && json[pos] == '{') ? JsonExtract::NOT_FOUND
+                                                                                 : JsonExtract::parseNumber(json, pos, value);
+            if (status == JsonExtract::NOT_FOUND) { // null or an object
+                status = JsonExtract::skipValue(json, pos);
+                if (status == JsonExtract::FOUND && value_key && json[begin] == '{' &&
+                    JsonExtract::number(json.substr(begin, pos - begin), value_key, value) != JsonExtract::FOUND)
+                    value = -1.0;
+            }
+            if (status != JsonExtract::FOUND) throw std::runtime_error(std::string("Truncated matrix: ") + key);
+            matrix.push_back(value);
+            separator();
+        }
+        expect(']');
+        separator();
+    }
+    return matrix;
+}
+
+// OSRM: route and table services (default port 5000)
+class OsrmBackend : public RoutingBackend {
+public:
+    std::string name() const override { return "osrm"; }
+    int defaultPort() const override { return 5000; }
+
+    EngineRequest routeRequest(double start_long, double start_lat, double end_long, double end_lat) const override {
+        std::string path = "/route/v1/driving/"
+            + dbl2str(start_long) + "," + dbl2str(start_lat) + ";"
+            + dbl2str(end_long) + "," + dbl2str(end_lat)
+            + "?overview=false";
+        return {"GET", path, ""};
+    }
+    std::string_view routeAnswerPath() const override { return "routes/0/duration"; }
+    double parseRouteAnswer(std::string_view answer) const override { return numberAt(answer, routeAnswerPath()); }
+
+    // the sources followed by the targets as coordinates
+    EngineRequest matrixRequest(const std::vector<Point>& sources, const std::vector<Point>& targets) const override {
+        std::string path = "/table/v1/driving/", source_ids, target_ids;
+        for (size_t i = 0; i < sources.size(); i++) {
+            path += dbl2str(sources[i].lon) + "," + dbl2str(sources[i].lat) + ";";
+            source_ids += (i ? ";" : "") + std::to_string(i);
+        }
+        for (size_t i = 0; i < targets.size(); i++) {
+            path += dbl2str(targets[i].lon) + "," + dbl2str(targets[i].lat) + ";";
+            target_ids += (i ? ";" : "") + std::to_string(sources.size() + i);
+        }
+        path.pop_back();
+        path += "?sources=" + source_ids + "&destinations=" + target_ids + "&annotations=duration";
+        return {"GET", path, ""};
+    }
+    std::vector<double> parseMatrixAnswer(std::string_view answer, size_t sources, size_t targets) const override {
+        return parseMatrixJson(answer, "durations", sources, targets);
+    }
+};
+
+// OpenRouteService: directions and matrix services (default port 8082)
+class OrsBackend : public RoutingBackend {
+public:
+    std::string name() const override { return "ors"; }
+    int defaultPort() const override { return 8082; }
+
+    EngineRequest routeRequest(double start_long, double start_lat, double end_long, double end_lat) const override {
+        std::string body = "{\"coordinates\":[[" 
+            + dbl2str(start_long) + "," + dbl2str(start_lat) + "],["
+            + dbl2str(end_long) + "," + dbl2str(end_lat) + "]]}";
+        return {"POST", "/ors/v2/directions/driving-car", body};
+    }
+    std::string_view routeAnswerPath() const override { return "routes/0/summary/duration"; }
+    double parseRouteAnswer(std::string_view answer) const override { return numberAt(answer, routeAnswerPath()); }
+
+    // the sources followed by the targets as locations
+    EngineRequest matrixRequest(const std::vector<Point>& sources, const std::vector<Point>& targets) const override {
+        std::string body = "{\"locations\":[", source_ids, target_ids;
+        for (size_t i = 0; i < sources.size(); i++) {
+            body += "[" + dbl2str(sources[i].lon) + "," + dbl2str(sources[i].lat) + "],";
+            source_ids += (i ? "," : "") + std::to_string(i);
+        }
+        for (size_t i = 0; i < targets.size(); i++) {
+            body += "[" + dbl2str(targets[i].lon) + "," + dbl2str(targets[i].lat) + "],";
+            target_ids += (i ? "," : "") + std::to_string(sources.size() + i);
+        }
+        body.pop_back();
+        body += "],\"sources\":[" + source_ids + "],\"destinations\":[" + target_ids + "],\"metrics\":[\"duration\"]}";
+        return {"POST", "/ors/v2/matrix/driving-car", body};
+    }
+    std::vector<double> parseMatrixAnswer(std::string_view answer, size_t sources, size_t targets) const override {
+        return parseMatrixJson(answer, "durations", sources, targets);
+    }
+};
+
+// Valhalla: route and sources_to_targets services (default port 8002)
+class ValhallaBackend : public RoutingBackend {
+public:
+    std::string name() const override { return "val"; }
+    int defaultPort() const override { return 8002; }
+
+    EngineRequest routeRequest(double start_long, double start_lat, double end_long, double end_lat) const override {
+        std::string body = "{\"locations\":["
+            "{\"lat\":" + dbl2str(start_lat) + ",\"lon\":" + dbl2str(start_long) + "},"
+            "{\"lat\":" + dbl2str(end_lat) + ",\"lon\":" + dbl2str(end_long) + "}],"
+            "\"costing\":\"auto\"}";
+        return {"POST", "/route", body};
+    }
+    std::string_view routeAnswerPath() const override { return "trip/summary/time"; }
+    double parseRouteAnswer(std::string_view answer) const override {
+        // the trip's time, else check for error_code 442 -> return -1
+        double time, ec;
+        if (JsonExtract::number(answer, routeAnswerPath(), time) == JsonExtract::FOUND) return time;
+        if (JsonExtract::number(answer, "error_code", ec) == JsonExtract::FOUND && (int)ec == 442) return -1.0;
+        throw std::runtime_error("Valhalla error: " + std::string(answer));
+    }
+
+    EngineRequest matrixRequest(const std::vector<Point>& sources, const std::vector<Point>& targets) const override {
+        auto locations = [](const std::vector<Point>& points) {
+            std::string list = "[";
+            for (size_t i = 0; i < points.size(); i++)
+                list += std::string(i ? "," : "") + "{\"lat\":" + dbl2str(points[i].lat) + ",\"lon\":" + dbl2str(points[i].lon) + "}";
+            return list + "]";
+        };
+        std::string body = "{\"sources\":" + locations(sources) + ",\"targets\":" + locations(targets) + ",\"costing\":\"auto\"}";
+        return {"POST", "/sources_to_targets", body};
+    }
+    std::vector<double> parseMatrixAnswer(std::string_view answer, size_t sources, size_t targets) const override {
+        return parseMatrixJson(answer, "sources_to_targets", sources, targets, "time"); // throws on an error answer (no matrix)
+    }
+};
+
+EngineRequest RoutingBackend::routeRequest(double, double, double, double) const {
+    throw std::logic_error(name() + " is not an HTTP routing backend");
+}
+
+std::string_view RoutingBackend::routeAnswerPath() const {
+    throw std::logic_error(name() + " is not an HTTP routing backend");
+}
+
+double RoutingBackend::parseRouteAnswer(std::string_view) const {
+    throw std::logic_error(name() + " is not an HTTP routing backend");
+}
+
+EngineRequest RoutingBackend::matrixRequest(const std::vector<Point>&, const std::vector<Point>&) const {
+    throw std::logic_error(name() + " is not an HTTP routing backend");
+}
+
+std::vector<double> RoutingBackend::parseMatrixAnswer(std::string_view, size_t, size_t) const {
+    throw std::logic_error(name() + " is not an HTTP routing backend");
+}
+
+double RoutingBackend::route(double, double, double, double) const {
+    throw std::logic_error(name() + " is not an in-process routing backend");
+}
+
+std::vector<double> RoutingBackend::matrix(const std::vector<Point>&, const std::vector<Point>&) const {
+    throw std::logic_error(name() + " is not an in-process routing backend");
+}
+
+std::unique_ptr<RoutingBackend> RoutingBackend::create(const std::string& engine) {
+    if (engine == "osrm") return std::make_unique<OsrmBackend>();
+    if (engine == "ors") return std::make_unique<OrsBackend>();
+    if (engine == "val") return std::make_unique<ValhallaBackend>();
+    if (engine == "mock") return std::make_unique<MockBackend>();
+    if (engine.compare(0, 5, "mock:") == 0) return std::make_unique<MockBackend>(engine.substr(5));
+    return nullptr;
+}
+
+MockBackend::MockBackend(const std::string& recorded_csv) {
+    if (recorded_csv.empty()) return;
+    std::ifstream f(recorded_csv);
+    if (!f.is_open()) throw std::runtime_error("Cannot open the recorded engine answers: " + recorded_csv);
+    std::string line;
+    std::getline(f, line); // Skip header
+    while (std::getline(f, line)) {
+        std::stringstream ss(line);
+        std::string field;
+        std::vector<std::string> fields;
+        while (std::getline(ss, field, ',')) fields.push_back(field);
+        if (fields.size() < 6) continue;
+        recorded[{std::stod(fields[0]), std::stod(fields[1]), std::stod(fields[2]), std::stod(fields[3])}] = std::stod(fields[5]);
+    }
+}
+
+size_t MockBackend::TripHash::operator()(const Trip& trip) const {
+    uint64_t h = 0;
+    for (double v : trip) {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        h = FlatHashIndex::hash(h ^ bits);
+    }
+    return static_cast<size_t>(h);
+}
+
+double MockBackend::route(double start_long, double start_lat, double end_long, double end_lat) const {
+    auto it = recorded.find({start_long, start_lat, end_long, end_lat});
+    if (it != recorded.end()) return it->second;
+
+    // 60 s plus the great circle distance (haversine) with a 1.3 detour factor at 30 km/h
+    const double to_rad = M_PI / 180.0;
+    double dlat = (end_lat - start_lat) * to_rad;
+    double dlon = (end_long - start_long) * to_rad;
+    double a = std::sin(dlat / 2) * std::sin(dlat / 2) +
+               std::cos(start_lat * to_rad) * std::cos(end_lat * to_rad) * std::sin(dlon / 2) * std::sin(dlon / 2);
+    double meters = 2 * 6371000.0 * std::asin(std::sqrt(a));
+    return 60.0 + meters * 1.3 / (30.0 / 3.6);
+}
+
+std::vector<double> MockBackend::matrix(const std::vector<Point>& sources, const std::vector<Point>& targets) const {
+    std::vector<double> etas;
+    etas.reserve(sources.size() * targets.size());
+    for (const auto& s : sources)
+        for (const auto& t : targets) etas.push_back(route(s.lon, s.lat, t.lon, t.lat));
+    return etas;
+}
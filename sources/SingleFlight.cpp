@@ -0,0 +1,27 @@
+#include "../headers/SingleFlight.hpp"
+
+
+bool SingleFlight::join(const std::string& key, Callback done) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = in_flight.find(key);
+    if (it == in_flight.end()) {
+        in_flight.emplace(key, std::vector<Callback>());
+        leader_count++;
+        return true;
+    }
+    it->second.push_back(std::move(done));
+    coalesced_count++;
+    return false;
+}
+
+void SingleFlight::complete(const std::string& key, double eta) {
+    std::vector<Callback> waiting;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = in_flight.find(key);
+        if (it == in_flight.end()) return;
+        waiting = std::move(it->second);
+        in_flight.erase(it);
+    }
+    for (auto& done : waiting) done(eta); // outside the lock, a callback may start the next call of key
+}
@@ -0,0 +1,378 @@
+#include "../headers/SpatialETATables.hpp"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <filesystem>
+#include <cstddef>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+std::unique_ptr<SpatialETAStore> SpatialETAStore::open(const std::string& path,
+                                                       const std::vector<std::string>& zone_ids,
+                                                       int record_size, int eta_offset) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        if (record_size != 8 || eta_offset != 0)
+            std::cerr << "Warning: the SpatialETA archive stores plain ETAs, ignoring record_size/eta_offset\n";
+        return std::unique_ptr<SpatialETAStore>(new SpatialETAArchive(path, zone_ids));
+    }
+    return std::unique_ptr<SpatialETAStore>(new SpatialETATableCache(path, zone_ids, record_size, eta_offset));
+}
+
+
+void SpatialETAStore::prefetch(const SpatialETATable& table, size_t max_bytes) {
+    size_t bytes = static_cast<size_t>(table.total) * table.record_size;
+    if (bytes == 0 || bytes > max_bytes) return;
+    // the tables start anywhere in an archive, madvise needs a page aligned start (still inside the mapping)
+    uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = reinterpret_cast<uintptr_t>(table.records);
+    uintptr_t start = begin & ~(page - 1);
+    madvise(reinterpret_cast<void*>(start), begin + bytes - start, MADV_WILLNEED);
+}
+
+std::vector<double> SpatialETAStore::buildSearchTree(const SpatialETATable& table, int max_levels, long long min_records) {
+    const long long LEAF_RECORDS = 512; // stop once the remaining range is about a page of ETAs
+    std::vector<double> tree;
+    if (max_levels <= 0 || table.total < min_records) return tree;
+
+    int levels = 0;
+    while (levels < max_levels && (table.total >> levels) > LEAF_RECORDS) levels++;
+    if (levels == 0) return tree;
+
+    // walk the binary search ranges level by level, nodes of empty ranges are never probed
+    long long size = (1LL << levels) - 1;
+    tree.assign(size, 0.0);
+    std::vector<long long> lo(size), hi(size);
+    lo[0] = 0; hi[0] = table.total - 1;
+    for (long long node = 0; node < size; node++) {
+        if (lo[node] > hi[node]) { // propagate the empty range
+            if (2 * node + 2 < size) { lo[2 * node + 1] = lo[2 * node + 2] = 1; hi[2 * node + 1] = hi[2 * node + 2] = 0; }
+            continue;
+        }
+        long long mid = lo[node] + (hi[node] - lo[node]) / 2;
+        tree[node] = table.eta(mid);
+        if (2 * node + 2 < size) {
+            lo[2 * node + 1] = lo[node]; hi[2 * node + 1] = mid - 1;
+            lo[2 * node + 2] = mid + 1;  hi[2 * node + 2] = hi[node];
+        }
+    }
+    return tree;
+}
+
+SpatialETATableCache::SpatialETATableCache(const std::string& folder,
+                                           const std::vector<std::string>& zone_ids,
+                                           int record_size,
+                                           int eta_offset,
+                                           size_t max_tables,
+                                           size_t max_bytes)
+    : folder(folder), zone_ids(zone_ids), record_size(record_size), eta_offset(eta_offset),
+      max_tables(max_tables), max_bytes(max_bytes) {}
+
+SpatialETATableCache::Handle SpatialETATableCache::get(uint32_t zone1, uint32_t zone2) const {
+    uint64_t key = (uint64_t(zone1) << 32) | zone2;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = tables.find(key);
+        if (it != tables.end()) {
+            hit_count++;
+            lru.splice(lru.begin(), lru, it->second); // mark as most recently used
+            const EntryPtr& entry = it->second->second;
+            return Handle(entry, &entry->table);
+        }
+        miss_count++;
+    }
+
+    int levels;
+    long long min_records;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        levels = tree_levels;
+        min_records = tree_min_records;
+    }
+
+    // map outside the lock so a cold table does not stall the hot ones
+    EntryPtr entry = map(zone1, zone2, levels, min_records);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = tables.find(key);
+    if (it != tables.end()) { // mapped concurrently by another thread
+        const EntryPtr& existing = it->second->second;
+        return Handle(existing, &existing->table);
+    }
+    lru.emplace_front(key, entry);
+    tables[key] = lru.begin();
+    mapped_bytes += entry->file.size();
+    evict();
+    return Handle(entry, &entry->table);
+}
+
+SpatialETATableCache::EntryPtr SpatialETATableCache::map(uint32_t zone1, uint32_t zone2, int levels, long long min_records) const {
+    if (zone1 >= zone_ids.size() || zone2 >= zone_ids.size()) throw std::out_of_range("Unknown zone index");
+
+    // Compose the filename of the spatial eta table bin file using the start and end zones
+    std::string filename = folder + "/" + zone_ids[zone1] + "_" + zone_ids[zone2] + ".bin";
+
+    auto entry = std::make_shared<Entry>();
+    entry->file = MappedFile(filename);
+    entry->file.advise(MADV_RANDOM); // binary search probes, readahead only wastes page cache
+    entry->table.records = entry->file.data();
+    entry->table.total = (long long)entry->file.size() / (long long)record_size;
+    entry->table.record_size = record_size;
+    entry->table.eta_offset = eta_offset;
+    entry->tree = buildSearchTree(entry->table, levels, min_records);
+    entry->table.tree = entry->tree.data();
+    entry->table.tree_size = static_cast<long long>(entry->tree.size());
+    return entry;
+}
+
+void SpatialETATableCache::setSearchTree(int max_levels, long long min_records) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tree_levels = max_levels;
+    tree_min_records = min_records;
+}
+
+void SpatialETATableCache::setLimits(size_t tables_limit, size_t bytes_limit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    max_tables = tables_limit;
+    max_bytes = bytes_limit;
+    evict();
+}
+
+void SpatialETATableCache::evict() const {
+    // always keep the most recently used table even if it is larger than max_bytes on its own
+    while (lru.size() > 1 && (lru.size() > max_tables || mapped_bytes > max_bytes)) {
+        auto& last = lru.back();
+        mapped_bytes -= last.second->file.size();
+        tables.erase(last.first);
+        lru.pop_back(); // unmapped once the last handle on it is released
+    }
+}
+
+uint64_t SpatialETATableCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hit_count;
+}
+
+uint64_t SpatialETATableCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return miss_count;
+}
+
+
+SpatialETAArchive::SpatialETAArchive(const std::string& path, const std::vector<std::string>& zone_ids)
+    : file(std::make_shared<MappedFile>(path)) {
+    const char* base = file->data();
+    size_t size = file->size();
+
+    // the v1 header is the v2 header without the quantile sketch fields
+    const size_t v1_header_size = offsetof(SpatialETAArchiveHeader, quantile_intervals);
+    if (size < v1_header_size) throw std::runtime_error("Truncated SpatialETA archive: " + path);
+    SpatialETAArchiveHeader header{};
+    memcpy(&header, base, v1_header_size);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) throw std::runtime_error("Not a SpatialETA archive: " + path);
+    if (header.version == VERSION) {
+        if (size < sizeof(header)) throw std::runtime_error("Truncated SpatialETA archive: " + path);
+        memcpy(&header, base, sizeof(header));
+    } else if (header.version != 1) {
+        throw std::runtime_error("Unsupported SpatialETA archive version " + std::to_string(header.version) + ": " + path);
+    }
+    quantile_intervals = header.quantile_intervals;
+    if (header.data_offset > size || header.data_offset % 8 != 0 ||
+        header.directory_offset + header.num_pairs * sizeof(SpatialETAArchiveEntry) > size)
+        throw std::runtime_error("Corrupt SpatialETA archive header: " + path);
+
+    // archive zone index -> runtime zone indices (a zone id can span several csv rows)
+    std::unordered_map<std::string, std::vector<uint32_t>> runtime;
+    for (uint32_t i = 0; i < zone_ids.size(); i++) runtime[zone_ids[i]].push_back(i);
+    std::vector<const std::vector<uint32_t>*> remap(header.num_zones, nullptr);
+    size_t pos = header.zones_offset;
+    for (uint32_t i = 0; i < header.num_zones; i++) {
+        uint32_t len;
+        if (pos + 4 > size) throw std::runtime_error("Corrupt SpatialETA archive zones: " + path);
+        memcpy(&len, base + pos, 4);
+        if (pos + 4 + len > size) throw std::runtime_error("Corrupt SpatialETA archive zones: " + path);
+        auto it = runtime.find(std::string(base + pos + 4, len));
+        if (it != runtime.end()) remap[i] = &it->second;
+        pos += 4 + len;
+    }
+
+    // a view per directory entry of the runtime zones, with a lookup slot per runtime zone pair
+    tables.reserve(header.num_pairs);
+    pairs.reserve(header.num_pairs);
+    const uint64_t num_etas = (size - header.data_offset) / sizeof(double);
+    for (uint64_t i = 0; i < header.num_pairs; i++) {
+        SpatialETAArchiveEntry entry;
+        memcpy(&entry, base + header.directory_offset + i * sizeof(entry), sizeof(entry));
+        if (entry.zone1 >= header.num_zones || entry.zone2 >= header.num_zones ||
+            entry.offset > num_etas || entry.count > num_etas - entry.offset)
+            throw std::runtime_error("Corrupt SpatialETA archive directory: " + path);
+        if (!remap[entry.zone1] || !remap[entry.zone2]) continue;
+
+        SpatialETATable table;
+        table.records = base + header.data_offset + entry.offset * sizeof(double);
+        table.total = static_cast<long long>(entry.count);
+        table.quantile_intervals = quantile_intervals;
+        for (uint32_t zone1 : *remap[entry.zone1])
+            for (uint32_t zone2 : *remap[entry.zone2])
+                pairs.insert((uint64_t(zone1) << 32) | zone2, tables.size());
+        tables.push_back(table);
+    }
+    served.reset(new std::atomic<const SpatialETATable*>[tables.size()]);
+    for (size_t i = 0; i < tables.size(); i++) served[i].store(nullptr, std::memory_order_relaxed);
+    if (quantile_intervals > 0) {
+        file->advise(MADV_WILLNEED); // a sketch is small, keep the whole spatial layer resident
+        std::cout << "Mapped the SpatialETA quantile sketch with " << tables.size() << " tables "
+                  << "(rank error <= " << 100.0 / quantile_intervals << " percentage points)!\n";
+    } else {
+        file->advise(MADV_RANDOM); // binary search probes, readahead only wastes page cache
+        std::cout << "Mapped the SpatialETA archive with " << tables.size() << " tables!\n";
+    }
+}
+
+SpatialETAStore::Handle SpatialETAArchive::get(uint32_t zone1, uint32_t zone2) const {
+    const FlatHashIndex::Slot* slot = pairs.find((uint64_t(zone1) << 32) | zone2);
+    if (!slot) throw std::runtime_error("No SpatialETA table for the zone pair in the archive");
+    const SpatialETATable* table = served[slot->value].load(std::memory_order_acquire);
+    if (!table) table = serve(slot->value);
+    return Handle(file, table); // shares the ownership of the mapping, no allocation
+}
+
+const SpatialETATable* SpatialETAArchive::serve(size_t idx) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const SpatialETATable* table = served[idx].load(std::memory_order_acquire);
+    if (table) return table; // served concurrently by another thread
+
+    std::vector<double> tree = buildSearchTree(tables[idx], tree_levels, tree_min_records);
+    if (tree.empty()) {
+        table = &tables[idx];
+    } else {
+        trees.push_back(std::move(tree));
+        accelerated.push_back(tables[idx]);
+        accelerated.back().tree = trees.back().data();
+        accelerated.back().tree_size = static_cast<long long>(trees.back().size());
+        table = &accelerated.back();
+    }
+    served[idx].store(table, std::memory_order_release);
+    return table;
+}
+
+void SpatialETAArchive::setSearchTree(int max_levels, long long min_records) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tree_levels = max_levels;
+    tree_min_records = min_records;
+}
+
+void SpatialETAArchive::build(const std::string& folder, const std::string& path, int record_size, int eta_offset,
+                              uint32_t quantile_intervals) {
+    namespace fs = std::filesystem;
+    auto align8 = [](uint64_t offset) { return (offset + 7) & ~uint64_t(7); };
+
+    // collect the tables <zone1>_<zone2>.bin sorted by zone ids
+    std::map<std::pair<std::string, std::string>, fs::path> files;
+    for (const auto& item : fs::directory_iterator(folder)) {
+        if (!item.is_regular_file() || item.path().extension() != ".bin") continue;
+        std::string stem = item.path().stem().string();
+        size_t sep = stem.find('_');
+        if (sep == std::string::npos) {
+            std::cerr << "Warning: skipping " << item.path() << ", not named <zone1>_<zone2>.bin\n";
+            continue;
+        }
+        files[{stem.substr(0, sep), stem.substr(sep + 1)}] = item.path();
+    }
+
+    // dense zone indices in sorted order, so the directory sorted by zone ids is also sorted by index
+    std::map<std::string, uint32_t> zones;
+    for (const auto& f : files) { zones.emplace(f.first.first, 0); zones.emplace(f.first.second, 0); }
+    uint32_t next = 0;
+    for (auto& z : zones) z.second = next++;
+
+    SpatialETAArchiveHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.num_zones = static_cast<uint32_t>(zones.size());
+    header.num_pairs = files.size();
+    header.quantile_intervals = quantile_intervals;
+    header.zones_offset = align8(sizeof(header));
+    uint64_t zones_size = 0;
+    for (const auto& z : zones) zones_size += 4 + z.first.size();
+    header.directory_offset = align8(header.zones_offset + zones_size);
+    header.data_offset = align8(header.directory_offset + header.num_pairs * sizeof(SpatialETAArchiveEntry));
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) throw std::runtime_error("Cannot create SpatialETA archive: " + path);
+    auto pad = [&out](uint64_t offset) { // zero fill up to offset
+        static const char zeros[8] = {};
+        uint64_t at = static_cast<uint64_t>(out.tellp());
+        if (offset > at) out.write(zeros, offset - at);
+    };
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(header.zones_offset);
+    for (const auto& z : zones) {
+        uint32_t len = static_cast<uint32_t>(z.first.size());
+        out.write(reinterpret_cast<const char*>(&len), 4);
+        out.write(z.first.data(), len);
+    }
+
+    // ETAs stored for a table of count records
+    auto stored = [quantile_intervals](uint64_t count) {
+        return (quantile_intervals > 0 && count > quantile_intervals + 1) ? uint64_t(quantile_intervals) + 1 : count;
+    };
+
+    // directory: the counts come from the file sizes
+    pad(header.directory_offset);
+    uint64_t offset = 0;
+    for (const auto& f : files) {
+        SpatialETAArchiveEntry entry{};
+        entry.zone1 = zones[f.first.first];
+        entry.zone2 = zones[f.first.second];
+        entry.offset = offset;
+        entry.count = stored(fs::file_size(f.second) / record_size);
+        out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        offset += entry.count;
+    }
+
+    // data: the ETA of every record (or the quantile knots), streamed table by table
+    pad(header.data_offset);
+    std::vector<char> buffer;
+    std::vector<double> etas;
+    for (const auto& f : files) {
+        uint64_t count = fs::file_size(f.second) / record_size;
+        if (stored(count) < count) {
+            // knot j is the ETA at the fractional rank j * (count - 1) / quantile_intervals
+            MappedFile table_file(f.second.string());
+            SpatialETATable table;
+            table.records = table_file.data();
+            table.total = static_cast<long long>(count);
+            table.record_size = record_size;
+            table.eta_offset = eta_offset;
+            etas.resize(quantile_intervals + 1);
+            for (uint32_t j = 0; j <= quantile_intervals; j++) {
+                double rank = double(j) * double(count - 1) / quantile_intervals;
+                long long r = std::min(static_cast<long long>(rank), table.total - 1);
+                double frac = rank - r;
+                etas[j] = (frac > 0 && r + 1 < table.total) ? table.eta(r) + frac * (table.eta(r + 1) - table.eta(r)) : table.eta(r);
+            }
+            out.write(reinterpret_cast<const char*>(etas.data()), etas.size() * sizeof(double));
+            continue;
+        }
+        std::ifstream in(f.second, std::ios::binary);
+        const uint64_t chunk = 1 << 16; // records per read
+        for (uint64_t done = 0; done < count; done += chunk) {
+            uint64_t n = std::min(chunk, count - done);
+            buffer.resize(n * record_size);
+            etas.resize(n);
+            in.read(buffer.data(), buffer.size());
+            if (!in) throw std::runtime_error("Failed reading " + f.second.string());
+            for (uint64_t i = 0; i < n; i++) memcpy(&etas[i], buffer.data() + i * record_size + eta_offset, sizeof(double));
+            out.write(reinterpret_cast<const char*>(etas.data()), n * sizeof(double));
+        }
+    }
+    if (!out) throw std::runtime_error("Failed writing SpatialETA archive: " + path);
+    std::cout << "Packed " << files.size() << " SpatialETA tables into " << path
+              << (quantile_intervals > 0 ? " as quantile sketches\n" : "\n");
+}
@@ -0,0 +1,380 @@
+#include "../headers/TimeZoning.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+TimeZoning::TimeZoning(TimeZoningType type) : type(type) {
+    setSeasons("4,4,1,1,1,2,2,2,3,3,3,4");
+    setHourRanges("0-6,7-10,11-13,14-16,17-19,20-23");
+}
+
+// the trimmed items of a comma separated list, false if one is empty
+static bool parseList(const std::string& list, std::vector<std::string>& items) {
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t start = item.find_first_not_of(" \t"), end = item.find_last_not_of(" \t");
+        if (start == std::string::npos) return false;
+        items.push_back(item.substr(start, end - start + 1));
+    }
+    return !items.empty();
+}
+
+static bool parseInt(const std::string& s, int& value) {
+    if (s.empty() || s.size() > 3 || !std::all_of(s.begin(), s.end(), ::isdigit)) return false;
+    value = std::stoi(s);
+    return true;
+}
+
+void TimeZoning::setSeasons(const std::string& month_seasons) {
+    std::vector<std::string> items;
+    int seasons[12];
+    bool ok = parseList(month_seasons, items) && items.size() == 12;
+    for (size_t m = 0; ok && m < 12; m++) ok = parseInt(items[m], seasons[m]) && seasons[m] <= 7;
+    if (!ok)
+        throw std::invalid_argument("Invalid seasons: " + month_seasons +
+                                    "\nShould be the season (0-7) of every month from January, e.g. 4,4,1,1,1,2,2,2,3,3,3,4\n");
+    std::copy(seasons, seasons + 12, month_season);
+    compile();
+}
+
+void TimeZoning::setHourRanges(const std::string& hour_ranges) {
+    std::vector<std::string> items;
+    std::vector<std::pair<int, int>> parsed;
+    bool ok = parseList(hour_ranges, items);
+    for (size_t i = 0; ok && i < items.size(); i++) {
+        size_t dash = items[i].find('-');
+        int first, last;
+        ok = dash != std::string::npos && parseInt(items[i].substr(0, dash), first) &&
+             parseInt(items[i].substr(dash + 1), last) && first <= last && last <= 23;
+        if (ok) parsed.push_back({first, last});
+    }
+    // every adjusted hour in exactly one range
+    std::sort(parsed.begin(), parsed.end());
+    for (size_t i = 0; ok && i < parsed.size(); i++) ok = parsed[i].first == (i ? parsed[i - 1].second + 1 : 0);
+    ok = ok && parsed.back().second == 23;
+    if (!ok)
+        throw std::invalid_argument("Invalid hour ranges: " + hour_ranges +
+                                    "\nShould be first-last hour ranges covering 0-23 once, e.g. 0-6,7-10,11-13,14-16,17-19,20-23\n");
+    ranges = parsed;
+    compile();
+}
+
+TimeZone TimeZoning::timeZone(const LocalTime& t) const {
+    TimeZone timeZone;
+    timeZone.day_of_week = t.weekday;
+    timeZone.daytype = (t.weekday >= 5) ? 1 : 0; // weekend : weekday
+
+    // Get hour and round to the nearest hour (add 1 if minute > 30), the day is kept
+    int hour_adjustment = (t.minute > 30) ? 1 : 0;
+    timeZone.adjusted_hour = (t.hour + hour_adjustment) % 24;
+
+    // Determine hour range period
+    for (const auto& range : ranges) {
+        if (timeZone.adjusted_hour >= range.first && timeZone.adjusted_hour <= range.second) {
+            timeZone.start_hour = range.first;
+            timeZone.end_hour = range.second;
+            break;
+        }
+    }
+    timeZone.season = month_season[t.month - 1];
+    return timeZone;
+}
+
+void TimeZoning::compile() {
+    if (ranges.empty()) return; // the constructor sets the seasons first
+    table.assign(12 * 7 * 24 * 2, 0);
+    for (int month = 1; month <= 12; month++)
+        for (int weekday = 0; weekday < 7; weekday++)
+            for (int hour = 0; hour < 24; hour++)
+                for (int half = 0; half < 2; half++) {
+                    LocalTime t{2000, month, 1, hour, half ? 31 : 0, 0, weekday};
+                    TimeZone z = timeZone(t);
+                    uint64_t bits = 0;
+                    switch (type) {
+                        case TimeZoningType::DOW_HOD:
+                            bits = HashKey::timeBits(z.season, z.day_of_week, z.adjusted_hour, 0);
+                            break;
+                        case TimeZoningType::DAYTYPE_HOD:
+                            bits = HashKey::timeBits(z.season, z.daytype, z.adjusted_hour, 0);
+                            break;
+                        case TimeZoningType::DOW_RANGE:
+                            bits = HashKey::timeBits(z.season, z.day_of_week, z.start_hour, z.end_hour);
+                            break;
+                        case TimeZoningType::DAYTYPE_RANGE:
+                            bits = HashKey::timeBits(z.season, z.daytype, z.start_hour, z.end_hour);
+                            break;
+                    }
+                    table[((month - 1) * 7 + weekday) * 48 + hour * 2 + half] = static_cast<uint16_t>(bits);
+                }
+}
+
+int64_t TimeZoning::daysFromCivil(int year, int month, int day) {
+    // days_from_civil of H. Hinnant's date algorithms
+    int64_t y = year - (month <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void TimeZoning::civilFromDays(int64_t days, int& year, int& month, int& day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    year = static_cast<int>(yoe + era * 400 + (month <= 2));
+}
+
+static bool isLeap(int year) { return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0; }
+
+static int daysInMonth(int year, int month) {
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return days[month - 1] + (month == 2 && isLeap(year));
+}
+
+// weekday (Mon=0) of the days since 1970-01-01, a Thursday
+static int weekdayOf(int64_t days) {
+    return static_cast<int>(((days + 3) % 7 + 7) % 7);
+}
+
+bool TimeZoning::parseTimestamp(std::string_view s, LocalTime& t) {
+    // YYYY-MM-DD HH:MM:SS
+    if (s.size() < 19) return false;
+    auto digits = [&s](size_t pos, size_t count, int& value) {
+        value = 0;
+        for (size_t i = pos; i < pos + count; i++) {
+            if (s[i] < '0' || s[i] > '9') return false;
+            value = value * 10 + (s[i] - '0');
+        }
+        return true;
+    };
+    if (!digits(0, 4, t.year) || s[4] != '-' || !digits(5, 2, t.month) || s[7] != '-' || !digits(8, 2, t.day) ||
+        (s[10] != ' ' && s[10] != 'T') ||
+        !digits(11, 2, t.hour) || s[13] != ':' || !digits(14, 2, t.minute) || s[16] != ':' || !digits(17, 2, t.second))
+        return false;
+    if (t.month < 1 || t.month > 12 || t.day < 1 || t.day > daysInMonth(t.year, t.month) ||
+        t.hour > 23 || t.minute > 59 || t.second > 60)
+        return false;
+    t.weekday = weekdayOf(daysFromCivil(t.year, t.month, t.day));
+    return true;
+}
+
+uint64_t TimeZoning::timeBits(std::string_view timestamp) const {
+    LocalTime t;
+    if (!parseTimestamp(timestamp, t))
+        throw std::invalid_argument("Failed to parse timestamp: " + std::string(timestamp));
+    return timeBits(t);
+}
+
+uint64_t TimeZoning::timeBits(int64_t epoch_seconds) const {
+    return timeBits(localTime(epoch_seconds));
+}
+
+int32_t TimeZoning::utcOffset(int64_t epoch_seconds) const {
+    size_t i = std::upper_bound(transitions.begin(), transitions.end(), epoch_seconds) - transitions.begin();
+    return i ? offsets[i - 1] : initial_offset;
+}
+
+LocalTime TimeZoning::localTime(int64_t epoch_seconds) const {
+    int64_t local = epoch_seconds + utcOffset(epoch_seconds);
+    int64_t days = local >= 0 ? local / 86400 : (local - 86399) / 86400;
+    int64_t seconds = local - days * 86400;
+    LocalTime t;
+    civilFromDays(days, t.year, t.month, t.day);
+    t.hour = static_cast<int>(seconds / 3600);
+    t.minute = static_cast<int>(seconds / 60 % 60);
+    t.second = static_cast<int>(seconds % 60);
+    t.weekday = weekdayOf(days);
+    return t;
+}
+
+// Rule of a POSIX TZ string (the footer of a TZif file), e.g. EST5EDT,M3.2.0,M11.1.0
+struct PosixRule {
+    char kind = 0;         // 'J' (1-365 without Feb 29), 'D' (0-365) or 'M' (month, week, day)
+    int day = 0, week = 0, month = 0;
+    int64_t time = 7200;   // local wall time of the change in seconds, 02:00 by default
+
+    // UTC time of the change in year, utoff is the offset in effect before it
+    int64_t at(int year, int32_t utoff) const {
+        int64_t days = daysFromYear(year);
+        if (kind == 'J') days += day - 1 + (isLeap(year) && day >= 60);
+        else if (kind == 'D') days += day;
+        else {
+            int64_t first = TimeZoning::daysFromCivil(year, month, 1);
+            int first_weekday = static_cast<int>(((first + 4) % 7 + 7) % 7); // Sunday=0, 1970-01-01 is a Thursday
+            int mday = 1 + (day - first_weekday + 7) % 7 + (week - 1) * 7;
+            while (mday > daysInMonth(year, month)) mday -= 7; // week 5 is the last one
+            days = first + mday - 1;
+        }
+        return days * 86400 + time - utoff;
+    }
+    static int64_t daysFromYear(int year) { return TimeZoning::daysFromCivil(year, 1, 1); }
+};
+
+// POSIX TZ string parser over the footer
+struct PosixCursor {
+    const std::string& s;
+    size_t pos = 0;
+
+    bool name() { // alphabetic or <quoted>
+        if (pos < s.size() && s[pos] == '<') {
+            size_t end = s.find('>', pos);
+            if (end == std::string::npos) return false;
+            pos = end + 1;
+            return true;
+        }
+        size_t start = pos;
+        while (pos < s.size() && std::isalpha(static_cast<unsigned char>(s[pos]))) pos++;
+        return pos - start >= 3;
+    }
+    bool clock(int64_t& seconds) { // [+-]hh[:mm[:ss]]
+        int sign = 1;
+        if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) sign = s[pos++] == '-' ? -1 : 1;
+        int64_t parts[3] = {0, 0, 0};
+        for (int k = 0; k < 3; k++) {
+            if (k && (pos >= s.size() || s[pos] != ':')) break;
+            if (k) pos++;
+            size_t start = pos;
+            while (pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]))) parts[k] = parts[k] * 10 + (s[pos++] - '0');
+            if (pos == start) return false;
+        }
+        seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+        return true;
+    }
+    bool number(int& value) {
+        size_t start = pos;
+        value = 0;
+        while (pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]))) value = value * 10 + (s[pos++] - '0');
+        return pos > start;
+    }
+    bool rule(PosixRule& r) {
+        if (pos < s.size() && s[pos] == 'M') {
+            pos++;
+            r.kind = 'M';
+            if (!number(r.month) || pos >= s.size() || s[pos++] != '.' || !number(r.week) || pos >= s.size() ||
+                s[pos++] != '.' || !number(r.day) || r.month < 1 || r.month > 12 || r.week < 1 || r.week > 5 || r.day > 6)
+                return false;
+        } else if (pos < s.size() && s[pos] == 'J') {
+            pos++;
+            r.kind = 'J';
+            if (!number(r.day) || r.day < 1 || r.day > 365) return false;
+        } else {
+            r.kind = 'D';
+            if (!number(r.day) || r.day > 365) return false;
+        }
+        if (pos < s.size() && s[pos] == '/') {
+            pos++;
+            return clock(r.time);
+        }
+        return true;
+    }
+};
+
+void TimeZoning::setLocalTimeZone(const std::string& name) {
+    if (name.empty() || name == "UTC") {
+        transitions.clear();
+        offsets.clear();
+        initial_offset = 0;
+        return;
+    }
+    std::string path = name[0] == '/' ? name : "/usr/share/zoneinfo/" + name;
+    auto invalid = [&](const std::string& why) {
+        return std::invalid_argument("Invalid time zone: " + name + " (" + why + ")" +
+                                     "\nShould be either \"UTC\", a tz database name (e.g. America/New_York) or a TZif file path\n");
+    };
+    std::ifstream f(path, std::ios::binary);
+    if (!f.is_open()) throw invalid("cannot read " + path);
+    std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    // TZif (RFC 8536): a v1 block with 32-bit times, then for v2+ a second header and block with 64-bit times and a footer
+    auto be = [&data](size_t pos, size_t bytes) {
+        uint64_t v = 0;
+        for (size_t i = 0; i < bytes; i++) v = (v << 8) | static_cast<unsigned char>(data[pos + i]);
+        return v;
+    };
+    struct Counts {
+        uint64_t isut, isstd, leap, time, type, chars;
+    };
+    auto header = [&](size_t pos, Counts& c) {
+        if (data.size() < pos + 44 || data.compare(pos, 4, "TZif") != 0) return false;
+        c = {be(pos + 20, 4), be(pos + 24, 4), be(pos + 28, 4), be(pos + 32, 4), be(pos + 36, 4), be(pos + 40, 4)};
+        return c.type > 0;
+    };
+    Counts c;
+    if (!header(0, c)) throw invalid("not a TZif file");
+    size_t time_size = 4, pos = 44;
+    if (data[4] >= '2') { // skip the v1 block
+        pos += c.time * 4 + c.time + c.type * 6 + c.chars + c.leap * 8 + c.isstd + c.isut;
+        if (!header(pos, c)) throw invalid("truncated TZif file");
+        pos += 44;
+        time_size = 8;
+    }
+    size_t block = c.time * time_size + c.time + c.type * 6 + c.chars + c.leap * (time_size + 4) + c.isstd + c.isut;
+    if (data.size() < pos + block) throw invalid("truncated TZif file");
+
+    std::vector<int64_t> times(c.time);
+    std::vector<int32_t> utoffs(c.type);
+    for (size_t i = 0; i < c.time; i++) {
+        uint64_t v = be(pos + i * time_size, time_size);
+        times[i] = time_size == 8 ? static_cast<int64_t>(v) : static_cast<int32_t>(static_cast<uint32_t>(v));
+    }
+    size_t types_pos = pos + c.time * time_size, info_pos = types_pos + c.time;
+    for (size_t k = 0; k < c.type; k++) utoffs[k] = static_cast<int32_t>(static_cast<uint32_t>(be(info_pos + k * 6, 4)));
+    std::vector<int32_t> time_offsets(c.time);
+    for (size_t i = 0; i < c.time; i++) {
+        size_t type_index = static_cast<unsigned char>(data[types_pos + i]);
+        if (type_index >= c.type) throw invalid("corrupt TZif file");
+        time_offsets[i] = utoffs[type_index];
+    }
+
+    // footer rule past the last transition, up to 2200
+    std::string footer;
+    if (time_size == 8 && data.size() > pos + block + 1 && data[pos + block] == '\n') {
+        size_t end = data.find('\n', pos + block + 1);
+        if (end != std::string::npos) footer = data.substr(pos + block + 1, end - pos - block - 1);
+    }
+    if (!footer.empty()) {
+        PosixCursor p{footer};
+        int64_t std_offset, dst_offset;
+        PosixRule start, end;
+        if (!p.name() || !p.clock(std_offset)) throw invalid("bad POSIX rule " + footer);
+        int32_t std_utoff = static_cast<int32_t>(-std_offset), dst_utoff = std_utoff + 3600;
+        if (p.pos < footer.size()) { // daylight saving time
+            if (!p.name()) throw invalid("bad POSIX rule " + footer);
+            if (p.pos < footer.size() && footer[p.pos] != ',') {
+                if (!p.clock(dst_offset)) throw invalid("bad POSIX rule " + footer);
+                dst_utoff = static_cast<int32_t>(-dst_offset);
+            }
+            if (p.pos >= footer.size() || footer[p.pos++] != ',' || !p.rule(start) ||
+                p.pos >= footer.size() || footer[p.pos++] != ',' || !p.rule(end) || p.pos != footer.size())
+                throw invalid("bad POSIX rule " + footer);
+            int first_year = 1970;
+            if (!times.empty()) {
+                int month, day;
+                civilFromDays(times.back() / 86400, first_year, month, day);
+            }
+            std::vector<std::pair<int64_t, int32_t>> changes;
+            for (int year = first_year; year <= 2200; year++) {
+                changes.push_back({start.at(year, std_utoff), dst_utoff});
+                changes.push_back({end.at(year, dst_utoff), std_utoff});
+            }
+            std::sort(changes.begin(), changes.end());
+            for (const auto& change : changes) {
+                if (!times.empty() && change.first <= times.back()) continue;
+                times.push_back(change.first);
+                time_offsets.push_back(change.second);
+            }
+        }
+    }
+
+    transitions = std::move(times);
+    offsets = std::move(time_offsets);
+    initial_offset = utoffs[0]; // local time type 0 before the first transition
+}
@@ -0,0 +1,94 @@
+#include "../headers/WorkerPool.hpp"
+#include <algorithm>
+
+
+WorkerPool::WorkerPool(size_t count) {
+    if (count == 0) count = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < count; i++) queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < count; i++) threads.emplace_back(&WorkerPool::work, this, i);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void WorkerPool::parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0) return;
+
+    // several chunks per worker so there is something left to steal, but not single items for cheap loops
+    size_t workers = threads.size();
+    size_t grain = std::max<size_t>(1, n / (workers * 16));
+    size_t chunks = (n + grain - 1) / grain;
+    Loop loop;
+    loop.fn = &fn;
+    loop.pending.store(chunks);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.fetch_add(chunks); // before the push so a worker taking a chunk never takes the count below 0
+    }
+    size_t w = next_queue.fetch_add(1) % workers;
+    for (size_t begin = 0; begin < n; begin += grain, w = (w + 1) % workers) {
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        queues[w]->chunks.push_back({&loop, begin, std::min(n, begin + grain)});
+    }
+    wake.notify_all();
+
+    // wait for the last chunk of this loop, the worker finishing it no longer touches loop
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&loop] { return loop.pending.load() == 0; });
+    if (loop.error) std::rethrow_exception(loop.error);
+}
+
+bool WorkerPool::take(size_t id, Chunk& chunk) {
+    {
+        Queue& own = *queues[id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.chunks.empty()) {
+            chunk = own.chunks.front();
+            own.chunks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); k++) {
+        Queue& victim = *queues[(id + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.back(); // steal the far end, away from the owner
+            victim.chunks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::work(size_t id) {
+    for (;;) {
+        Chunk chunk;
+        if (!take(id, chunk)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping) return;
+            continue;
+        }
+
+        Loop& loop = *chunk.loop;
+        try {
+            for (size_t i = chunk.begin; i < chunk.end; i++) (*loop.fn)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!loop.error) loop.error = std::current_exception();
+        }
+        if (loop.pending.fetch_sub(1) == 1) {
+            // notify under the mutex so the caller is either waiting or has not checked pending yet
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    }
+}
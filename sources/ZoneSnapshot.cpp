@@ -0,0 +1,240 @@
+#include "../headers/ZoneSnapshot.hpp"
+#include "../headers/MappedFile.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// size and modification time of the csv, false if it cannot be read
+static bool csvState(const std::string& csv_path, uint64_t& size, int64_t& mtime_ns) {
+    struct stat st;
+    if (stat(csv_path.c_str(), &st) != 0) return false;
+    size = static_cast<uint64_t>(st.st_size);
+    mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+ZoneStore::ZoneStore(SnapshotReader& in) {
+    uint64_t count = in.value<uint64_t>();
+    zone_ids.reserve(count);
+    for (uint64_t z = 0; z < count; z++) zone_ids.push_back(in.string());
+    in.array(zone_bboxes);
+    in.array(zone_polygons);
+    in.array(polygons);
+    in.array(vertices);
+    in.edges(edges);
+
+    if (zone_bboxes.size() != count || zone_polygons.size() != count + 1 || zone_polygons.back() != polygons.size() ||
+        edges.size() != vertices.size())
+        throw std::runtime_error("Corrupt zones in zone snapshot");
+    for (size_t z = 0; z < count; z++)
+        if (zone_polygons[z] > zone_polygons[z + 1]) throw std::runtime_error("Corrupt zones in zone snapshot");
+    for (const PolygonRange& range : polygons)
+        if (range.begin > range.end || range.end > vertices.size()) throw std::runtime_error("Corrupt zones in zone snapshot");
+}
+
+void ZoneStore::save(SnapshotWriter& out) const {
+    out.value<uint64_t>(zone_ids.size());
+    for (const auto& id : zone_ids) out.string(id);
+    out.array(zone_bboxes);
+    out.array(zone_polygons);
+    out.array(polygons);
+    out.array(vertices);
+    out.edges(edges);
+}
+
+void SpatialIndex::save(SnapshotWriter&) const {
+    throw std::runtime_error("This spatial index cannot be saved in a zone snapshot");
+}
+
+std::unique_ptr<SpatialIndex> SpatialIndex::load(const std::string& type, std::shared_ptr<const ZoneStore> zones,
+                                                 SnapshotReader& in) {
+    if (type == "grid") return std::make_unique<GridIndex>(zones, in);
+    if (type == "quadtree") return std::make_unique<QuadTreeIndex>(zones, in);
+    throw std::invalid_argument("Unknown spatial index: " + type +
+                                "\nShould be either \"grid\" or \"quadtree\"\n");
+}
+
+GridIndex::GridIndex(std::shared_ptr<const ZoneStore> z, SnapshotReader& in) : SpatialIndex(std::move(z)) {
+    min_lon = in.value<double>(); max_lon = in.value<double>();
+    min_lat = in.value<double>(); max_lat = in.value<double>();
+    cells_per_degree = in.value<int32_t>();
+    grid_size_x = in.value<int32_t>();
+    grid_size_y = in.value<int32_t>();
+    cell_width = in.value<double>();
+    cell_height = in.value<double>();
+    in.array(cells);
+    in.array(boundary);
+    in.array(cell_zones);
+    in.array(cell_polygons);
+    in.edges(edges);
+    in.array(toggles);
+    covered_count = in.value<uint64_t>();
+    empty_count = in.value<uint64_t>();
+
+    // the lookups index these without checks
+    if (grid_size_x <= 0 || grid_size_y <= 0 || cells.size() != static_cast<size_t>(grid_size_x) * grid_size_y)
+        throw std::runtime_error("Corrupt grid in zone snapshot");
+    for (uint32_t cell : cells) {
+        if ((cell & KIND) == COVERED && (cell & ~KIND) >= zones->size()) throw std::runtime_error("Corrupt grid in zone snapshot");
+        if ((cell & KIND) == BOUNDARY && (cell & ~KIND) >= boundary.size()) throw std::runtime_error("Corrupt grid in zone snapshot");
+    }
+    for (const BoundaryCell& b : boundary)
+        if (b.zone_begin > b.zone_end || b.zone_end > cell_zones.size()) throw std::runtime_error("Corrupt grid in zone snapshot");
+    for (const CellZone& cell_zone : cell_zones)
+        if (cell_zone.zone >= zones->size() || cell_zone.polygon_begin > cell_zone.polygon_end ||
+            cell_zone.polygon_end > cell_polygons.size())
+            throw std::runtime_error("Corrupt grid in zone snapshot");
+    for (const CellPolygon& polygon : cell_polygons)
+        if (polygon.edge_begin > polygon.edge_end || polygon.edge_end > edges.size() ||
+            polygon.toggle_begin > polygon.toggle_end || polygon.toggle_end > toggles.size())
+            throw std::runtime_error("Corrupt grid in zone snapshot");
+}
+
+void GridIndex::save(SnapshotWriter& out) const {
+    out.value(min_lon); out.value(max_lon);
+    out.value(min_lat); out.value(max_lat);
+    out.value<int32_t>(cells_per_degree);
+    out.value<int32_t>(grid_size_x);
+    out.value<int32_t>(grid_size_y);
+    out.value(cell_width);
+    out.value(cell_height);
+    out.array(cells);
+    out.array(boundary);
+    out.array(cell_zones);
+    out.array(cell_polygons);
+    out.edges(edges);
+    out.array(toggles);
+    out.value<uint64_t>(covered_count);
+    out.value<uint64_t>(empty_count);
+}
+
+QuadTreeIndex::QuadTreeIndex(std::shared_ptr<const ZoneStore> z, SnapshotReader& in) : SpatialIndex(std::move(z)) {
+    in.array(nodes);
+    in.array(leaf_zones);
+    bounds = in.value<BBox>();
+    leaf_size = in.value<uint64_t>();
+    max_depth = in.value<int32_t>();
+    leaf_count = in.value<uint64_t>();
+    max_reached = in.value<int32_t>();
+
+    if (nodes.empty()) throw std::runtime_error("Corrupt quadtree in zone snapshot");
+    for (const Node& node : nodes)
+        if ((node.child >= 0 && static_cast<size_t>(node.child) + 4 > nodes.size()) ||
+            node.begin > node.end || node.end > leaf_zones.size())
+            throw std::runtime_error("Corrupt quadtree in zone snapshot");
+    for (uint32_t zone : leaf_zones)
+        if (zone >= zones->size()) throw std::runtime_error("Corrupt quadtree in zone snapshot");
+}
+
+void QuadTreeIndex::save(SnapshotWriter& out) const {
+    out.array(nodes);
+    out.array(leaf_zones);
+    out.value(bounds);
+    out.value<uint64_t>(leaf_size);
+    out.value<int32_t>(max_depth);
+    out.value<uint64_t>(leaf_count);
+    out.value<int32_t>(max_reached);
+}
+
+ZoneSnapshot ZoneSnapshot::open(const std::string& csv_path) {
+    ZoneSnapshot snapshot;
+    std::string path = pathOf(csv_path);
+    auto start = std::chrono::high_resolution_clock::now();
+    if (snapshot.load(path, csv_path)) {
+        std::cout << "Loaded " << snapshot.zones->size() << " zones and their " << snapshot.index_type << " index from "
+                  << path << " in " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+                  << " ms\n";
+        return snapshot;
+    }
+
+    bool stated = csvState(csv_path, snapshot.csv_size, snapshot.csv_mtime_ns); // before parsing, a later change invalidates the snapshot
+    snapshot.zones = std::make_shared<const ZoneStore>(WKTParser::parseCSV(csv_path));
+    snapshot.index = SpatialIndex::create(snapshot.index_type, snapshot.zones, snapshot.leaf_size, snapshot.cells_per_degree);
+    if (!stated) return snapshot; // no csv to snapshot
+    try {
+        snapshot.save(path, *snapshot.index);
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << ", the zones are parsed again on the next start\n";
+    }
+    return snapshot;
+}
+
+bool ZoneSnapshot::load(const std::string& path, const std::string& csv_path) {
+    uint64_t csv_size;
+    int64_t csv_mtime_ns;
+    if (!csvState(csv_path, csv_size, csv_mtime_ns)) return false;
+    MappedFile file;
+    try {
+        file = MappedFile(path);
+    } catch (const std::exception&) {
+        return false; // no snapshot yet
+    }
+
+    ZoneSnapshotHeader header;
+    if (file.size() < sizeof(header)) return false;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.index_type > 1 ||
+        header.csv_size != csv_size || header.csv_mtime_ns != csv_mtime_ns)
+        return false; // another format or a stale snapshot
+
+    try {
+        SnapshotReader in(file.data() + sizeof(header), file.size() - sizeof(header));
+        std::string type = header.index_type == 0 ? "grid" : "quadtree";
+        auto loaded = std::make_shared<const ZoneStore>(in);
+        index = SpatialIndex::load(type, loaded, in);
+        zones = loaded;
+        index_type = type;
+        leaf_size = header.leaf_size;
+        cells_per_degree = header.cells_per_degree;
+        this->csv_size = csv_size;
+        this->csv_mtime_ns = csv_mtime_ns;
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: ignoring the zone snapshot " << path << ": " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool ZoneSnapshot::matches(const std::string& type, size_t leaf_size, int cells_per_degree) const {
+    if (type != index_type) return false;
+    if (type == "grid") return cells_per_degree == this->cells_per_degree;
+    return leaf_size == this->leaf_size;
+}
+
+void ZoneSnapshot::save(const std::string& path, const SpatialIndex& index) const {
+    ZoneSnapshotHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    if (index_type != "grid" && index_type != "quadtree") throw std::runtime_error("Cannot snapshot a " + index_type + " index");
+    header.index_type = index_type == "grid" ? 0 : 1;
+    header.csv_size = csv_size;
+    header.csv_mtime_ns = csv_mtime_ns;
+    header.leaf_size = leaf_size;
+    header.cells_per_degree = cells_per_degree;
+
+    SnapshotWriter out;
+    out.value(header);
+    zones->save(out);
+    index.save(out);
+
+    // a reader never sees a partly written snapshot, and processes saving at the same time each write their own
+    // temporary file (the last rename wins)
+    std::string tmp = path + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd < 0) throw std::runtime_error("Cannot create zone snapshot: " + tmp);
+    bool ok = fchmod(fd, 0644) == 0; // mkstemp creates it 0600
+    for (size_t written = 0; ok && written < out.bytes.size();) {
+        ssize_t n = ::write(fd, out.bytes.data() + written, out.bytes.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        ok = n > 0;
+        if (ok) written += n;
+    }
+    ok = (close(fd) == 0) && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Failed writing zone snapshot: " + path);
+    }
+}
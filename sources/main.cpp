@@ -20,6 +20,22 @@ int main(int argc, char* argv[]) {
 
                           
     coarseETA.setAggregateTypeField(cfg.aggregate_type);  // aggregate_type
+    coarseETA.setAggregateStorage(cfg.aggregate_storage, cfg.aggregate_precision);  // aggregate_storage, aggregate_precision
+    coarseETA.setSpatialTableCache(cfg.spatial_cache_tables, cfg.spatial_cache_mb);  // spatial_cache_tables, spatial_cache_mb
+    coarseETA.setSpatialSearchTree(cfg.spatial_search_levels, cfg.spatial_search_min_records);  // spatial_search_levels, spatial_search_min_records
+    coarseETA.setSpatialIndex(cfg.spatial_index, cfg.spatial_index_leaf_size, cfg.spatial_grid_cells_per_degree);  // spatial_index, spatial_index_leaf_size, spatial_grid_cells_per_degree
+    coarseETA.setPointInPolygonKernel(cfg.spatial_pip_kernel);  // spatial_pip_kernel
+    coarseETA.setTimeZoning(cfg.time_seasons, cfg.time_hour_ranges, cfg.time_zone);  // time_seasons, time_hour_ranges, time_zone
+    coarseETA.setEnginePoolSize(cfg.engine_pool_size);  // engine_pool_size
+    coarseETA.setEngineMatrixLimit(cfg.engine_matrix_max_locations);  // engine_matrix_max_locations
+    coarseETA.setWorkerThreads(cfg.worker_threads);  // worker_threads
+    coarseETA.setEngineCache(cfg.engine_cache_entries, cfg.engine_cache_precision, cfg.engine_cache_ttl_s);  // engine_cache_entries, engine_cache_precision, engine_cache_ttl_s
+    coarseETA.setEngineCoalescing(cfg.engine_coalesce);  // engine_coalesce
+    coarseETA.setEngineTimeouts(cfg.engine_connect_timeout_ms, cfg.engine_read_timeout_ms);  // engine_connect_timeout_ms, engine_read_timeout_ms
+    coarseETA.setEngineDeadline(cfg.engine_deadline_ms, cfg.deadline_fallback);  // engine_deadline_ms, deadline_fallback
+    coarseETA.setEngineHedging(cfg.engine_hedge_percentile);  // engine_hedge_percentile
+    coarseETA.setEngineAsync(cfg.engine_async_connections, cfg.engine_pipeline_depth);  // engine_async_connections, engine_pipeline_depth
+    coarseETA.setAsyncPipeline(cfg.pipeline_pre_threads, cfg.pipeline_post_threads, cfg.pipeline_prefetch_kb);  // pipeline_pre_threads, pipeline_post_threads, pipeline_prefetch_kb
 
     ETAQuery query;
     query.start_long = -73.95267486572266;
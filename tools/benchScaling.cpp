@@ -0,0 +1,77 @@
+// Throughput of ETAParallelRequest from 1 thread up to max_threads (doubling) over a csv of queries:
+//   start_long,start_lat,end_long,end_lat,start_datetime (with a header line)
+// The routing engine pool is sized to the threads of each run so every thread has its own connection
+#include "../headers/CoarseETA.hpp"
+#include "../config/config.hpp"
+#include <thread>
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <config.ini> <queries.csv> [max_threads (hardware threads)] [repeat 1]\n";
+        return 1;
+    }
+
+    Config cfg = Config::load(argv[1]);
+    CoarseETA coarseETA(cfg.spatial_eta_path, cfg.hashindex_file, cfg.zones_csv_file,
+                        cfg.routingengine_server, cfg.engine, static_cast<TimeZoningType>(cfg.time_zoning_type));
+    coarseETA.setAggregateTypeField(cfg.aggregate_type);
+    coarseETA.setAggregateStorage(cfg.aggregate_storage, cfg.aggregate_precision);
+    coarseETA.setSpatialTableCache(cfg.spatial_cache_tables, cfg.spatial_cache_mb);
+    coarseETA.setSpatialSearchTree(cfg.spatial_search_levels, cfg.spatial_search_min_records);
+
+    size_t max_threads = (argc > 3) ? std::stoul(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+    int repeat = (argc > 4) ? std::stoi(argv[4]) : 1;
+
+    std::ifstream f(argv[2]);
+    if (!f.is_open()) { std::cerr << "Cannot open queries: " << argv[2] << "\n"; return 1; }
+    std::string line;
+    std::getline(f, line); // Skip header
+    std::vector<ETAQuery> queries;
+    while (std::getline(f, line)) {
+        std::stringstream ss(line);
+        std::string field;
+        std::vector<std::string> fields;
+        while (std::getline(ss, field, ',')) fields.push_back(field);
+        if (fields.size() < 5) continue;
+        queries.push_back({std::stod(fields[0]), std::stod(fields[1]), std::stod(fields[2]), std::stod(fields[3]), fields[4]});
+    }
+    if (queries.empty()) { std::cerr << "No queries in " << argv[2] << "\n"; return 1; }
+    std::cout << "Running " << queries.size() << " queries x " << repeat << "\n";
+
+    std::vector<size_t> thread_counts;
+    for (size_t t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    double base_qps = 0;
+    for (size_t threads : thread_counts) {
+        coarseETA.setWorkerThreads(threads);
+        coarseETA.setEnginePoolSize(threads);
+        std::vector<Timing> timings;
+        coarseETA.ETAParallelRequest(queries, timings); // warm up the connections and the mapped tables
+
+        double engine = 0, overhead = 0;
+        size_t failed = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeat; r++) {
+            std::vector<double> etas = coarseETA.ETAParallelRequest(queries, timings);
+            for (size_t i = 0; i < etas.size(); i++) {
+                if (etas[i] < 0) failed++;
+                engine += timings[i].routing_engine;
+                overhead += timings[i].coarseETA;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        size_t n = queries.size() * repeat;
+        double qps = n / seconds;
+        if (threads == 1) base_qps = qps;
+        std::cout << "threads " << threads
+                  << ": " << qps << " queries/s"
+                  << " (x" << qps / base_qps << ")"
+                  << ", mean engine " << engine / n << " ms"
+                  << ", mean CoarseETA overhead " << overhead / n << " ms"
+                  << ", failed " << failed << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Point lookup cost of the grid and the quadtree zone indices on a zones csv (e.g. the NYC taxi zones)
+// The points are half uniform over the zones' bounds and half jittered around zone vertices, so dense areas
+// (many small zones, many vertices) get their share of lookups. Every index must find the zones of a linear scan
+// The point in polygon kernels are then checked against the scalar ray casting (Polygon::contains) on a corpus of
+// boundary points of every polygon: its vertices, points on its edges and points at the latitude of a vertex
+#include "../headers/ReadZones.hpp"
+#include <chrono>
+#include <random>
+
+// first zone containing the point in index order, the reference answer
+class ScanIndex : public SpatialIndex {
+public:
+    using SpatialIndex::SpatialIndex;
+    uint32_t findZoneIndex(double lon, double lat) const override {
+        for (uint32_t i = 0; i < zones->size(); i++)
+            if (zones->containsPoint(i, Point{lon, lat})) return i;
+        return ZoneStore::NO_ZONE;
+    }
+    size_t candidates(double lon, double lat) const override {
+        size_t count = 0;
+        for (uint32_t i = 0; i < zones->size(); i++) count += zones->bbox(i).contains(Point{lon, lat});
+        return count;
+    }
+};
+
+struct Run {
+    double ns_per_lookup;
+    double mean_candidates;
+    size_t max_candidates;
+    std::vector<uint32_t> found;
+};
+
+static Run lookup(const SpatialIndex& index, const std::vector<Point>& points, int repeat) {
+    Run run{0, 0, 0, std::vector<uint32_t>(points.size())};
+    size_t total = 0;
+    for (const auto& p : points) {
+        size_t c = index.candidates(p.lon, p.lat);
+        total += c;
+        run.max_candidates = std::max(run.max_candidates, c);
+    }
+    run.mean_candidates = double(total) / points.size();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeat; r++)
+        for (size_t i = 0; i < points.size(); i++) run.found[i] = index.findZoneIndex(points[i].lon, points[i].lat);
+    run.ns_per_lookup = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count()
+                        / (double(points.size()) * repeat);
+    return run;
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <zones.csv> [points 1000000] [leaf_sizes 4,8,16] [repeat 3] [grid cells_per_degree 0 (auto)]\n";
+        return 1;
+    }
+    std::vector<Zone> zones = WKTParser::parseCSV(argv[1]);
+    if (zones.empty()) { std::cerr << "No zones in " << argv[1] << "\n"; return 1; }
+    auto store = std::make_shared<const ZoneStore>(zones);
+    size_t count = (argc > 2) ? std::stoul(argv[2]) : 1000000;
+    std::string leaf_list = (argc > 3) ? argv[3] : "4,8,16";
+    int repeat = (argc > 4) ? std::stoi(argv[4]) : 3;
+    int cells_per_degree = (argc > 5) ? std::stoi(argv[5]) : 0;
+
+    BBox bounds;
+    std::vector<Point> vertices;
+    for (const auto& zone : zones) {
+        bounds.expand({zone.bbox.min_lon, zone.bbox.min_lat});
+        bounds.expand({zone.bbox.max_lon, zone.bbox.max_lat});
+        for (const auto& poly : zone.polygons) vertices.insert(vertices.end(), poly.vertices.begin(), poly.vertices.end());
+    }
+
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> lon(bounds.min_lon, bounds.max_lon), lat(bounds.min_lat, bounds.max_lat);
+    std::uniform_int_distribution<size_t> vertex(0, vertices.size() - 1);
+    std::normal_distribution<double> jitter(0.0, 0.002); // ~200 m
+    std::vector<Point> points(count);
+    for (size_t i = 0; i < count; i++) {
+        if (i % 2 == 0) points[i] = {lon(rng), lat(rng)};
+        else {
+            const Point& v = vertices[vertex(rng)];
+            points[i] = {v.lon + jitter(rng), v.lat + jitter(rng)};
+        }
+    }
+    std::cout << zones.size() << " zones, " << vertices.size() << " vertices, " << count << " points x " << repeat << "\n";
+
+    Run base = lookup(ScanIndex(store), points, 1);
+    size_t matched = 0;
+    for (uint32_t z : base.found) matched += z != ZoneStore::NO_ZONE;
+    printf("%-16s %8.1f ns/lookup  candidates mean %6.2f max %4zu  (%zu points in a zone)\n",
+           "scan", base.ns_per_lookup, base.mean_candidates, base.max_candidates, matched);
+    int status = 0;
+    auto mismatches = [&](const Run& run) {
+        size_t count = 0;
+        for (size_t i = 0; i < points.size(); i++) count += run.found[i] != base.found[i];
+        if (count) status = 1;
+        return count;
+    };
+
+    // the fixed 10 cells per degree grid, then the requested resolution
+    for (int resolution : {10, cells_per_degree}) {
+        auto build_start = std::chrono::high_resolution_clock::now();
+        GridIndex grid(store, resolution);
+        double build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - build_start).count();
+        Run run = lookup(grid, points, repeat);
+        std::string name = "grid/" + std::to_string(grid.cellsPerDegree());
+        printf("%-16s build %8.2f ms  %8.1f ns/lookup  candidates mean %6.2f max %4zu  (cells covered %zu empty %zu boundary %zu, %zu mismatches)\n",
+               name.c_str(), build_ms, run.ns_per_lookup, run.mean_candidates, run.max_candidates,
+               grid.coveredCells(), grid.emptyCells(), grid.boundaryCells(), mismatches(run));
+    }
+
+    // the batch lookup (Morton sorted, one thread) of the last grid
+    {
+        GridIndex grid(store, cells_per_degree);
+        std::vector<double> lons(count), lats(count);
+        for (size_t i = 0; i < count; i++) {
+            lons[i] = points[i].lon;
+            lats[i] = points[i].lat;
+        }
+        Run run{0, 0, 0, std::vector<uint32_t>(count)};
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeat; r++) grid.findZoneIndices(lons.data(), lats.data(), count, run.found.data());
+        run.ns_per_lookup = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count()
+                            / (double(count) * repeat);
+        std::string name = "grid/" + std::to_string(grid.cellsPerDegree()) + " batch";
+        printf("%-16s %8.1f ns/lookup  (%zu mismatches)\n", name.c_str(), run.ns_per_lookup, mismatches(run));
+    }
+
+    std::stringstream ss(leaf_list);
+    std::string leaf;
+    while (std::getline(ss, leaf, ',')) {
+        size_t leaf_size = std::stoul(leaf);
+        auto build_start = std::chrono::high_resolution_clock::now();
+        QuadTreeIndex tree(store, leaf_size);
+        double build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - build_start).count();
+        Run run = lookup(tree, points, repeat);
+        std::string name = "quadtree/" + leaf;
+        printf("%-16s build %8.2f ms  %8.1f ns/lookup  candidates mean %6.2f max %4zu  (%zu leaves, depth %d, %zu mismatches)\n",
+               name.c_str(), build_ms, run.ns_per_lookup, run.mean_candidates, run.max_candidates,
+               tree.leaves(), tree.depth(), mismatches(run));
+    }
+    // corpus of boundary points per polygon
+    struct Probe {
+        const Polygon* polygon;
+        uint32_t stored; // the polygon in the store
+        Point p;
+    };
+    std::vector<Probe> probes;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    uint32_t stored = 0;
+    for (const auto& zone : zones) {
+        for (const auto& poly : zone.polygons) {
+            const BBox& b = zone.bbox;
+            for (size_t i = 0; i < poly.vertices.size(); i++) {
+                const Point& v = poly.vertices[i];
+                const Point& w = poly.vertices[(i + 1) % poly.vertices.size()];
+                double t = unit(rng);
+                probes.push_back({&poly, stored, v});
+                probes.push_back({&poly, stored, {v.lon + (w.lon - v.lon) * t, v.lat + (w.lat - v.lat) * t}});
+                probes.push_back({&poly, stored, {b.min_lon + (b.max_lon - b.min_lon) * unit(rng), v.lat}});
+                probes.push_back({&poly, stored, {v.lon, b.min_lat + (b.max_lat - b.min_lat) * unit(rng)}});
+                probes.push_back({&poly, stored, {std::nextafter(v.lon, 180.0), std::nextafter(v.lat, -90.0)}});
+            }
+            stored++;
+        }
+    }
+    std::vector<char> expected(probes.size());
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeat; r++)
+        for (size_t i = 0; i < probes.size(); i++) expected[i] = probes[i].polygon->contains(probes[i].p);
+    printf("%-16s %8.1f ns/polygon test over %zu boundary points\n", "rayCast",
+           std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count()
+           / (double(probes.size()) * repeat), probes.size());
+
+    std::string selected = PointInPolygon::selected();
+    for (const std::string& kernel : PointInPolygon::available()) {
+        PointInPolygon::select(kernel);
+        std::vector<char> found(probes.size());
+        start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeat; r++)
+            for (size_t i = 0; i < probes.size(); i++) found[i] = store->polygonContains(probes[i].stored, probes[i].p);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count()
+                    / (double(probes.size()) * repeat);
+        size_t count = 0;
+        for (size_t i = 0; i < probes.size(); i++) count += found[i] != expected[i];
+        if (count) status = 1;
+        std::string name = "kernel/" + kernel;
+        printf("%-16s %8.1f ns/polygon test  (%zu mismatches)\n", name.c_str(), ns, count);
+    }
+    PointInPolygon::select(selected);
+    return status;
+}
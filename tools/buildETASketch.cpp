@@ -0,0 +1,31 @@
+// Build the quantile sketch archive of a folder of SpatialETA tables (<zone1>_<zone2>.bin)
+// Set spatial_eta_path to the sketch to answer the rank percentage from it instead of the full tables
+#include "../headers/SpatialETATables.hpp"
+#include <iostream>
+#include <string>
+#include <cmath>
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <SpatialETATables folder> <output sketch> <max rank error in percentage points>"
+                     " [record_size 8] [eta_offset 0]\n";
+        return 1;
+    }
+
+    try {
+        double max_rank_error = std::stod(argv[3]);
+        if (!(max_rank_error > 0 && max_rank_error <= 100)) throw std::invalid_argument("max rank error should be in (0, 100]");
+        int record_size = (argc > 4) ? std::stoi(argv[4]) : 8;
+        int eta_offset = (argc > 5) ? std::stoi(argv[5]) : 0;
+
+        // the rank error is at most 100 / intervals percentage points
+        uint32_t intervals = static_cast<uint32_t>(std::ceil(100.0 / max_rank_error));
+        std::cout << "Keeping " << intervals + 1 << " quantile knots per table\n";
+        SpatialETAArchive::build(argv[1], argv[2], record_size, eta_offset, intervals);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
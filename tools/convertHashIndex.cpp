@@ -0,0 +1,32 @@
+// Convert a v1 hash index bin file of the offline phase to the memory mappable format,
+// optionally keeping a single aggregate type and quantizing the values
+#include "../headers/HashIndex.hpp"
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <v1 hash index .bin> <output .bin> <time_zoning_type 0-3>"
+                     " [aggregate_type all|min_max|min_med_max|percentiles] [precision f64|f32|u16]\n";
+        return 1;
+    }
+
+    try {
+        TimeZoningType time_zoning_type = static_cast<TimeZoningType>(std::stoi(argv[3]));
+        HashIndex index(time_zoning_type); // no runtime zones: intern every zone found in the keys
+        index.load(argv[1]);
+
+        // keep only one aggregate type and/or quantize the values
+        AggregateField field = HashIndex::parseAggregateField(argc > 4 ? argv[4] : "all");
+        AggregatePrecision precision = HashIndex::parseAggregatePrecision(argc > 5 ? argv[5] : "f64");
+        if (field != ALL_FIELDS || precision != F64) index.compact(field, precision);
+
+        index.save(argv[2]);
+        std::cout << "Wrote " << index.size() << " entries to " << argv[2] << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
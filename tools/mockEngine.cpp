@@ -0,0 +1,170 @@
+// Loopback OSRM stand-in answering from MockBackend, to load test and benchmark CoarseETA's HTTP path without an engine
+// Serves the route and table services over HTTP/1.1 keep-alive (a thread per connection), delay_ms is added to every
+// answer to mimic the engine's latency. Point a config at it with engine = osrm and routingengine_server = 127.0.0.1:<port>,
+// its ETAs are the ones of engine = mock (or mock:<recorded.csv>) in process
+#include "../headers/RoutingBackend.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+// the ;-separated lon,lat coordinates of an OSRM path up to the query
+static std::vector<Point> parseCoordinates(const std::string& coordinates) {
+    std::vector<Point> points;
+    size_t pos = 0;
+    while (pos < coordinates.size()) {
+        size_t end = coordinates.find(';', pos);
+        if (end == std::string::npos) end = coordinates.size();
+        std::string pair = coordinates.substr(pos, end - pos);
+        size_t comma = pair.find(',');
+        if (comma == std::string::npos) throw std::runtime_error("Bad coordinate: " + pair);
+        points.push_back({std::stod(pair.substr(0, comma)), std::stod(pair.substr(comma + 1))});
+        pos = end + 1;
+    }
+    return points;
+}
+
+// the ;-separated indices of the query parameter name, all of count if it is missing
+static std::vector<size_t> parseIndices(const std::string& query, const std::string& name, size_t count) {
+    std::vector<size_t> indices;
+    size_t pos = query.find(name + "=");
+    if (pos == std::string::npos) {
+        for (size_t i = 0; i < count; i++) indices.push_back(i);
+        return indices;
+    }
+    pos += name.size() + 1;
+    size_t end = query.find('&', pos);
+    std::string list = query.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    for (size_t begin = 0; begin < list.size();) {
+        size_t sep = list.find(';', begin);
+        if (sep == std::string::npos) sep = list.size();
+        size_t index = std::stoul(list.substr(begin, sep - begin));
+        if (index >= count) throw std::runtime_error("Index out of range: " + name);
+        indices.push_back(index);
+        begin = sep + 1;
+    }
+    return indices;
+}
+
+// %.17g so the ETAs read back are the in-process ones
+static std::string number(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", v);
+    return buf;
+}
+
+// json answer of the OSRM request path, status 400 on a bad request
+static std::string answer(const MockBackend& mock, const std::string& target, int& status) {
+    status = 200;
+    try {
+        size_t question = target.find('?');
+        std::string path = target.substr(0, question);
+        std::string query = question == std::string::npos ? "" : target.substr(question + 1);
+
+        const std::string route = "/route/v1/driving/", table = "/table/v1/driving/";
+        if (path.compare(0, route.size(), route) == 0) {
+            std::vector<Point> points = parseCoordinates(path.substr(route.size()));
+            if (points.size() != 2) throw std::runtime_error("A route needs 2 coordinates");
+            double eta = mock.route(points[0].lon, points[0].lat, points[1].lon, points[1].lat);
+            return "{\"code\":\"Ok\",\"routes\":[{\"duration\":" + number(eta) + "}]}";
+        }
+        if (path.compare(0, table.size(), table) == 0) {
+            std::vector<Point> points = parseCoordinates(path.substr(table.size()));
+            std::vector<Point> sources, targets;
+            for (size_t i : parseIndices(query, "sources", points.size())) sources.push_back(points[i]);
+            for (size_t i : parseIndices(query, "destinations", points.size())) targets.push_back(points[i]);
+            std::vector<double> etas = mock.matrix(sources, targets);
+            std::string json = "{\"code\":\"Ok\",\"durations\":[";
+            for (size_t r = 0; r < sources.size(); r++) {
+                json += r ? ",[" : "[";
+                for (size_t c = 0; c < targets.size(); c++) json += (c ? "," : "") + number(etas[r * targets.size() + c]);
+                json += "]";
+            }
+            return json + "]}";
+        }
+        throw std::runtime_error("Unknown service: " + path);
+    } catch (const std::exception& e) {
+        status = 400;
+        return "{\"code\":\"InvalidQuery\",\"message\":\"" + std::string(e.what()) + "\"}";
+    }
+}
+
+// answer the requests of one connection until the client closes it
+static void serve(int sock, const MockBackend& mock, int delay_ms) {
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::string in;
+    char buf[1 << 16];
+    for (;;) {
+        size_t header_end;
+        while ((header_end = in.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(sock, buf, sizeof(buf), 0);
+            if (n <= 0) { close(sock); return; }
+            in.append(buf, n);
+        }
+        // request line and the body length (the route and table services are GETs, a body is skipped)
+        std::string headers = in.substr(0, header_end);
+        size_t body_length = 0, cl = headers.find("Content-Length:");
+        if (cl != std::string::npos) body_length = std::stoul(headers.substr(cl + 15));
+        while (in.size() < header_end + 4 + body_length) {
+            ssize_t n = recv(sock, buf, sizeof(buf), 0);
+            if (n <= 0) { close(sock); return; }
+            in.append(buf, n);
+        }
+        size_t sp1 = headers.find(' '), sp2 = headers.find(' ', sp1 + 1);
+        std::string target = headers.substr(sp1 + 1, sp2 - sp1 - 1);
+        in.erase(0, header_end + 4 + body_length);
+
+        int status;
+        std::string body = answer(mock, target, status);
+        if (delay_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        std::string response = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Bad Request") +
+                               "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+                               "\r\nConnection: keep-alive\r\n\r\n" + body;
+        for (size_t sent = 0; sent < response.size();) {
+            ssize_t n = send(sock, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) { close(sock); return; }
+            sent += n;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <port> [recorded queries.csv with os_eta] [delay_ms 0]\n";
+        return 1;
+    }
+    int port = std::stoi(argv[1]);
+    MockBackend mock((argc > 2) ? argv[2] : "");
+    int delay_ms = (argc > 3) ? std::stoi(argv[3]) : 0;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listener, 1024) < 0) {
+        std::cerr << "Cannot listen on 127.0.0.1:" << port << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    std::cout << "Mock OSRM on 127.0.0.1:" << port << " (" << mock.recordedTrips() << " recorded trips, "
+              << delay_ms << " ms delay)" << std::endl;
+
+    for (;;) {
+        int sock = accept(listener, nullptr, nullptr);
+        if (sock < 0) continue;
+        std::thread(serve, sock, std::cref(mock), delay_ms).detach();
+    }
+}
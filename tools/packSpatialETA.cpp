@@ -0,0 +1,22 @@
+// Pack a folder of SpatialETA tables (<zone1>_<zone2>.bin) into a single SpatialETA archive
+#include "../headers/SpatialETATables.hpp"
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <SpatialETATables folder> <output archive> [record_size 8] [eta_offset 0]\n";
+        return 1;
+    }
+
+    try {
+        int record_size = (argc > 3) ? std::stoi(argv[3]) : 8;
+        int eta_offset = (argc > 4) ? std::stoi(argv[4]) : 0;
+        SpatialETAArchive::build(argv[1], argv[2], record_size, eta_offset);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
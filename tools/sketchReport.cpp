@@ -0,0 +1,62 @@
+// Compare the final ETAs of the quantile sketch mode against the exact mode (full SpatialETA tables)
+// for a csv of queries with their known routing engine ETA:
+//   start_long,start_lat,end_long,end_lat,start_datetime,os_eta (with a header line)
+#include "../headers/CoarseETA.hpp"
+#include "../config/config.hpp"
+#include <algorithm>
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <config.ini (exact spatial_eta_path)> <sketch archive> <queries.csv>\n";
+        return 1;
+    }
+
+    Config cfg = Config::load(argv[1]);
+    TimeZoningType time_zoning_type = static_cast<TimeZoningType>(cfg.time_zoning_type);
+    CoarseETA exact(cfg.spatial_eta_path, cfg.hashindex_file, cfg.zones_csv_file,
+                    cfg.routingengine_server, cfg.engine, time_zoning_type);
+    CoarseETA sketch(argv[2], cfg.hashindex_file, cfg.zones_csv_file,
+                     cfg.routingengine_server, cfg.engine, time_zoning_type);
+    exact.setAggregateTypeField(cfg.aggregate_type);
+    sketch.setAggregateTypeField(cfg.aggregate_type);
+
+    std::ifstream f(argv[3]);
+    if (!f.is_open()) { std::cerr << "Cannot open queries: " << argv[3] << "\n"; return 1; }
+    std::string line;
+    std::getline(f, line); // Skip header
+
+    std::vector<double> abs_errors, rel_errors;
+    size_t failed = 0;
+    while (std::getline(f, line)) {
+        std::stringstream ss(line);
+        std::string field;
+        std::vector<std::string> fields;
+        while (std::getline(ss, field, ',')) fields.push_back(field);
+        if (fields.size() < 6) continue;
+
+        ETAQuery query{std::stod(fields[0]), std::stod(fields[1]), std::stod(fields[2]), std::stod(fields[3]), fields[4]};
+        double os_eta = std::stod(fields[5]);
+        double exact_eta = exact.ETAFromEngineETA(query, os_eta);
+        double sketch_eta = sketch.ETAFromEngineETA(query, os_eta);
+        if (exact_eta < 0 || sketch_eta < 0) { failed++; continue; }
+
+        abs_errors.push_back(std::abs(sketch_eta - exact_eta));
+        rel_errors.push_back(exact_eta > 0 ? 100.0 * abs_errors.back() / exact_eta : 0.0);
+    }
+
+    if (abs_errors.empty()) { std::cerr << "No query could be answered (" << failed << " failed)\n"; return 1; }
+    auto report = [](const char* name, std::vector<double>& v, const char* unit) {
+        std::sort(v.begin(), v.end());
+        double sum = 0;
+        for (double x : v) sum += x;
+        std::cout << name << ": mean " << sum / v.size() << unit
+                  << ", p50 " << v[v.size() / 2] << unit
+                  << ", p99 " << v[std::min(v.size() - 1, v.size() * 99 / 100)] << unit
+                  << ", max " << v.back() << unit << "\n";
+    };
+    std::cout << "Compared " << abs_errors.size() << " queries (" << failed << " failed in either mode)\n";
+    report("Absolute ETA error", abs_errors, " s");
+    report("Relative ETA error", rel_errors, " %");
+    return 0;
+}